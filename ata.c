@@ -0,0 +1,395 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Polled ATA/IDE disk driver with bus master DMA for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+#define ATA_TIMEOUT_MS          5000
+#define ATA_DMA_MAX_SECTORS     2048 /* 1MB, needs at most 17 PRDs */
+
+static ATA_DRIVE AtaDrives[ATA_MAX_DRIVES];
+static u32 AtaDriveCount;
+
+/* 256 bytes aligned to 256 bytes, so the table itself never crosses a 64K boundary */
+static ATA_PRD AtaPrdTable[ATA_PRD_COUNT] __aligned(0x100);
+
+/* FUNCTIONS ******************************************************************/
+
+/* Reading the alternate status register four times gives the drive its 400ns to update status */
+static
+void AtaDelay(PATA_DRIVE Drive) {
+    for (int i = 0; i < 4; i++) {
+        inb(Drive->ControlBase);
+    }
+}
+
+/* Wait for BSY to clear and return the final status, or 0xFF on timeout */
+static
+u8 AtaWaitNotBusy(PATA_DRIVE Drive) {
+    int Timeout = mseconds() + ATA_TIMEOUT_MS;
+    u8 Status;
+
+    while ((Status = inb(Drive->IoBase + ATA_REG_STATUS)) & ATA_STATUS_BSY) {
+        if (mseconds() > Timeout) {
+            return 0xFF;
+        }
+    }
+    return Status;
+}
+
+/* Wait for the drive to be ready to transfer data */
+static
+bool AtaWaitDrq(PATA_DRIVE Drive) {
+    u8 Status = AtaWaitNotBusy(Drive);
+
+    if (Status == 0xFF || (Status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        return FALSE;
+    }
+    return (Status & ATA_STATUS_DRQ) != 0;
+}
+
+/*
+ * Select the drive and wait until it can take a command. Status only reflects the newly selected drive 400ns after
+ * the device register is written, which matters when master and slave on one channel are used alternately.
+ */
+static
+bool AtaSelect(PATA_DRIVE Drive, u8 Device) {
+    u8 Status;
+
+    if (AtaWaitNotBusy(Drive) == 0xFF) {
+        return FALSE;
+    }
+    outb(Drive->IoBase + ATA_REG_DEVICE, Device | (Drive->Slave << 4));
+    AtaDelay(Drive);
+
+    Status = AtaWaitNotBusy(Drive);
+    return Status != 0xFF && !(Status & ATA_STATUS_DRQ);
+}
+
+/* Select the drive, program the task file and issue a read command */
+static
+bool AtaIssueCommand(PATA_DRIVE Drive, u64 Lba, u32 Count, u8 Command) {
+    u16 IoBase = Drive->IoBase;
+
+    if (!AtaSelect(Drive, Drive->Lba48 ? 0x40 : (0xE0 | ((Lba >> 24) & 0x0F)))) {
+        return FALSE;
+    }
+    if (Drive->Lba48) {
+        /* high order bytes first, the registers are two deep */
+        outb(IoBase + ATA_REG_SECCOUNT, (Count >> 8) & 0xFF);
+        outb(IoBase + ATA_REG_LBA0, (Lba >> 24) & 0xFF);
+        outb(IoBase + ATA_REG_LBA1, (Lba >> 32) & 0xFF);
+        outb(IoBase + ATA_REG_LBA2, (Lba >> 40) & 0xFF);
+    }
+    outb(IoBase + ATA_REG_SECCOUNT, Count & 0xFF);
+    outb(IoBase + ATA_REG_LBA0, Lba & 0xFF);
+    outb(IoBase + ATA_REG_LBA1, (Lba >> 8) & 0xFF);
+    outb(IoBase + ATA_REG_LBA2, (Lba >> 16) & 0xFF);
+    outb(IoBase + ATA_REG_COMMAND, Command);
+    return TRUE;
+}
+
+/* Read sectors one at a time through the data port */
+static
+bool AtaReadPio(PATA_DRIVE Drive, u64 Lba, u32 Count, u8 *Buffer) {
+    if (!AtaIssueCommand(Drive, Lba, Count, Drive->Lba48 ? ATA_CMD_READ_SECTORS_EXT : ATA_CMD_READ_SECTORS)) {
+        return FALSE;
+    }
+    AtaDelay(Drive);
+
+    for (u32 i = 0; i < Count; i++) {
+        if (!AtaWaitDrq(Drive)) {
+            return FALSE;
+        }
+        insw(Drive->IoBase + ATA_REG_DATA, Buffer, ATA_SECTOR_SIZE / 2);
+        Buffer += ATA_SECTOR_SIZE;
+    }
+    return TRUE;
+}
+
+/* Describe a buffer as physical regions, splitting at 64K boundaries */
+static
+bool AtaBuildPrdTable(u8 *Buffer, u32 Length) {
+    u32 Address = (u32) Buffer;
+    u32 i = 0;
+
+    while (Length != 0) {
+        u32 Boundary = 0x10000 - (Address & 0xFFFF);
+        u32 Size = (Length < Boundary) ? Length : Boundary;
+
+        if (i == ATA_PRD_COUNT) {
+            return FALSE;
+        }
+        AtaPrdTable[i].Address = Address;
+        AtaPrdTable[i].ByteCount = Size & 0xFFFF; /* 64K is encoded as 0 */
+        AtaPrdTable[i].Flags = 0;
+        Address += Size;
+        Length -= Size;
+        i++;
+    }
+    AtaPrdTable[i - 1].Flags = ATA_PRD_EOT;
+    return TRUE;
+}
+
+/* Start a bus master transfer; it runs until AtaFinishDma() is called */
+static
+bool AtaStartDma(PATA_DRIVE Drive, u64 Lba, u32 Count, u8 *Buffer) {
+    u16 BusMaster = Drive->BusMasterBase;
+
+    if (!AtaBuildPrdTable(Buffer, Count * ATA_SECTOR_SIZE)) {
+        return FALSE;
+    }
+    outb(BusMaster + ATA_BM_COMMAND, 0);
+    outl(BusMaster + ATA_BM_PRDT, (u32) AtaPrdTable);
+    /* error and interrupt bits are write-1-to-clear */
+    outb(BusMaster + ATA_BM_STATUS, inb(BusMaster + ATA_BM_STATUS) | ATA_BM_STATUS_ERROR | ATA_BM_STATUS_IRQ);
+
+    if (!AtaIssueCommand(Drive, Lba, Count, Drive->Lba48 ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA)) {
+        return FALSE;
+    }
+    outb(BusMaster + ATA_BM_COMMAND, ATA_BM_CMD_READ);
+    outb(BusMaster + ATA_BM_COMMAND, ATA_BM_CMD_READ | ATA_BM_CMD_START);
+    return TRUE;
+}
+
+/* Wait for the running bus master transfer to complete; fails as soon as the controller or the drive gives up */
+static
+bool AtaFinishDma(PATA_DRIVE Drive) {
+    u16 BusMaster = Drive->BusMasterBase;
+    int Timeout = mseconds() + ATA_TIMEOUT_MS;
+    u8 BusMasterStatus;
+    u8 Status;
+
+    for (;;) {
+        BusMasterStatus = inb(BusMaster + ATA_BM_STATUS);
+        if (!(BusMasterStatus & ATA_BM_STATUS_ACTIVE) ||
+            (BusMasterStatus & (ATA_BM_STATUS_ERROR | ATA_BM_STATUS_IRQ))) {
+            break;
+        }
+        /* the alternate status register does not acknowledge the drive's interrupt */
+        Status = inb(Drive->ControlBase);
+        if (Status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+            break;
+        }
+        if (!(Status & (ATA_STATUS_BSY | ATA_STATUS_DRQ))) {
+            /* the command is over; the bus master has seen the interrupt by now unless the transfer fell short */
+            BusMasterStatus = inb(BusMaster + ATA_BM_STATUS);
+            break;
+        }
+        if (mseconds() > Timeout) {
+            break;
+        }
+    }
+    outb(BusMaster + ATA_BM_COMMAND, 0);
+    Status = AtaWaitNotBusy(Drive);
+    outb(BusMaster + ATA_BM_STATUS, BusMasterStatus | ATA_BM_STATUS_ERROR | ATA_BM_STATUS_IRQ);
+
+    if ((BusMasterStatus & (ATA_BM_STATUS_ACTIVE | ATA_BM_STATUS_ERROR)) ||
+        Status == 0xFF || (Status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        error("ATA DMA failed (status 0x%02X, bus master status 0x%02X)\n", Status, BusMasterStatus);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Identify the drive and fill in its geometry. ATAPI devices are ignored. */
+static
+bool AtaIdentify(PATA_DRIVE Drive) {
+    u16 Identify[256];
+    u16 IoBase = Drive->IoBase;
+
+    outb(IoBase + ATA_REG_DEVICE, 0xA0 | (Drive->Slave << 4));
+    AtaDelay(Drive);
+    outb(IoBase + ATA_REG_SECCOUNT, 0);
+    outb(IoBase + ATA_REG_LBA0, 0);
+    outb(IoBase + ATA_REG_LBA1, 0);
+    outb(IoBase + ATA_REG_LBA2, 0);
+    outb(IoBase + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    AtaDelay(Drive);
+
+    if (inb(IoBase + ATA_REG_STATUS) == 0 || AtaWaitNotBusy(Drive) == 0xFF) {
+        return FALSE;
+    }
+    if (inb(IoBase + ATA_REG_LBA1) != 0 || inb(IoBase + ATA_REG_LBA2) != 0) {
+        return FALSE;
+    }
+    if (!AtaWaitDrq(Drive)) {
+        return FALSE;
+    }
+    insw(IoBase + ATA_REG_DATA, Identify, 256);
+
+    /* LBA is mandatory, CHS-only drives are not worth supporting */
+    if (!(Identify[49] & (1 << 9))) {
+        return FALSE;
+    }
+    Drive->Lba48 = (Identify[83] & (1 << 10)) != 0;
+    if (Drive->Lba48) {
+        Drive->SectorCount = ((u64) Identify[103] << 48) | ((u64) Identify[102] << 32) |
+                             ((u64) Identify[101] << 16) | Identify[100];
+    } else {
+        Drive->SectorCount = ((u32) Identify[61] << 16) | Identify[60];
+    }
+    Drive->Dma = Drive->Dma && (Identify[49] & (1 << 8));
+
+    /* model string is stored as byte-swapped words */
+    for (int i = 0; i < 20; i++) {
+        Drive->Model[i * 2] = Identify[27 + i] >> 8;
+        Drive->Model[i * 2 + 1] = Identify[27 + i] & 0xFF;
+    }
+    Drive->Model[40] = '\0';
+    for (int i = 39; i >= 0 && Drive->Model[i] == ' '; i--) {
+        Drive->Model[i] = '\0';
+    }
+
+    Drive->Present = TRUE;
+    return TRUE;
+}
+
+/* Probe both drives on one channel */
+static
+void AtaProbeChannel(u16 IoBase, u16 ControlBase, u16 BusMasterBase) {
+    /* a floating bus reads all ones */
+    if (inb(IoBase + ATA_REG_STATUS) == 0xFF) {
+        return;
+    }
+    /* this driver polls */
+    outb(ControlBase, ATA_CTRL_NIEN);
+
+    for (u8 Slave = 0; Slave < 2 && AtaDriveCount < ATA_MAX_DRIVES; Slave++) {
+        PATA_DRIVE Drive = &AtaDrives[AtaDriveCount];
+
+        memset(Drive, 0, sizeof(ATA_DRIVE));
+        Drive->IoBase = IoBase;
+        Drive->ControlBase = ControlBase;
+        Drive->BusMasterBase = BusMasterBase;
+        Drive->Slave = Slave;
+        Drive->Dma = (BusMasterBase != 0);
+
+        if (AtaIdentify(Drive)) {
+            debug_printf("ATA drive %u: %s, %u sectors%s%s\n", AtaDriveCount, Drive->Model,
+                         lo32(Drive->SectorCount), Drive->Lba48 ? ", LBA48" : "", Drive->Dma ? ", DMA" : "");
+            AtaDriveCount++;
+        }
+    }
+}
+
+/* Find IDE controllers and the drives attached to them. Returns the number of drives found. */
+u32 AtaInit() {
+    u8 Device, Function;
+
+    AtaDriveCount = 0;
+    for (u32 Index = 0; PciFindClass(0x01, 0x01, Index, &Device, &Function); Index++) {
+        u8 ProgIf = (PciConfigRead32(0, Device, Function, PCI_CLASS_REVISION) >> 8) & 0xFF;
+        u32 Bar[5];
+        u16 BusMaster = 0;
+
+        for (int i = 0; i < 5; i++) {
+            Bar[i] = PciConfigRead32(0, Device, Function, PCI_BAR0 + (i * 4)) & ~3;
+        }
+
+        /* make sure I/O decoding and bus mastering are on */
+        u32 Command = PciConfigRead32(0, Device, Function, PCI_COMMAND);
+        Command |= PCI_COMMAND_IO;
+        if ((ProgIf & 0x80) && Bar[4] != 0) {
+            Command |= PCI_COMMAND_MASTER;
+            BusMaster = Bar[4];
+        }
+        PciConfigWrite32(0, Device, Function, PCI_COMMAND, Command & 0xFFFF);
+
+        /* prog-if bits 0 and 2 select native mode for the primary and secondary channel */
+        if (ProgIf & 0x01) {
+            AtaProbeChannel(Bar[0], Bar[1] + 2, BusMaster);
+        } else {
+            AtaProbeChannel(0x1F0, 0x3F6, BusMaster);
+        }
+        if (ProgIf & 0x04) {
+            AtaProbeChannel(Bar[2], Bar[3] + 2, BusMaster ? BusMaster + 8 : 0);
+        } else {
+            AtaProbeChannel(0x170, 0x376, BusMaster ? BusMaster + 8 : 0);
+        }
+    }
+
+    return AtaDriveCount;
+}
+
+PATA_DRIVE AtaGetDrive(u32 Index) {
+    if (Index >= AtaDriveCount) {
+        return NULL;
+    }
+    return &AtaDrives[Index];
+}
+
+/*
+ * Read Count sectors into Buffer. If a callback is given, it is called with each completed chunk while the
+ * controller is already transferring the next one, so checksumming or decompressing overlaps with disk I/O.
+ */
+bool AtaStreamSectors(PATA_DRIVE Drive, u64 Lba, u32 Count, void *Buffer,
+                      ATA_CHUNK_CALLBACK Callback, void *Context) {
+    u8 *Position = (u8 *) Buffer;
+    u32 MaxChunk = ATA_DMA_CHUNK_SECTORS;
+    u32 Chunk;
+
+    if (!Drive || !Drive->Present || Lba + Count > Drive->SectorCount) {
+        return FALSE;
+    }
+    /* without a callback there is nothing to overlap, so use the largest command the drive allows */
+    if (!Callback && Drive->Lba48) {
+        MaxChunk = ATA_DMA_MAX_SECTORS;
+    }
+
+    /* PIO fallback; bus mastering also needs a word aligned buffer */
+    if (!Drive->Dma || ((u32) Position & 1)) {
+        while (Count != 0) {
+            Chunk = (Count < ATA_DMA_CHUNK_SECTORS) ? Count : ATA_DMA_CHUNK_SECTORS;
+            if (!AtaReadPio(Drive, Lba, Chunk, Position)) {
+                return FALSE;
+            }
+            if (Callback) {
+                Callback(Position, Chunk * ATA_SECTOR_SIZE, Context);
+            }
+            Lba += Chunk;
+            Count -= Chunk;
+            Position += Chunk * ATA_SECTOR_SIZE;
+        }
+        return TRUE;
+    }
+
+    Chunk = (Count < MaxChunk) ? Count : MaxChunk;
+    if (Count != 0 && !AtaStartDma(Drive, Lba, Chunk, Position)) {
+        return FALSE;
+    }
+    while (Count != 0) {
+        u8 *Done = Position;
+        u32 DoneLength = Chunk * ATA_SECTOR_SIZE;
+
+        if (!AtaFinishDma(Drive)) {
+            return FALSE;
+        }
+        Lba += Chunk;
+        Count -= Chunk;
+        Position += DoneLength;
+
+        /* kick off chunk N+1 before handing chunk N to the callback */
+        if (Count != 0) {
+            Chunk = (Count < MaxChunk) ? Count : MaxChunk;
+            if (!AtaStartDma(Drive, Lba, Chunk, Position)) {
+                return FALSE;
+            }
+        }
+        if (Callback) {
+            Callback(Done, DoneLength, Context);
+        }
+    }
+    return TRUE;
+}
+
+bool AtaReadSectors(PATA_DRIVE Drive, u64 Lba, u32 Count, void *Buffer) {
+    return AtaStreamSectors(Drive, Lba, Count, Buffer, NULL, NULL);
+}
@@ -0,0 +1,169 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Command line tokenizer and loader options for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+static CMDLINE_OPTION CmdlineOptions[CMDLINE_MAX_OPTIONS];
+static u32 CmdlineOptionCount;
+static u32 CmdlineLoaderOptions;
+
+/* Keys and values of all options; never longer than the command line, as each separator becomes a terminator */
+static char CmdlineStorage[MACH_CMDLINE];
+
+/* FUNCTIONS ******************************************************************/
+
+static inline
+bool CmdlineIsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool CmdlineEquals(const char *s1, const char *s2) {
+    while (*s1 != '\0' && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return *s1 == *s2;
+}
+
+/*
+ * Split the command line into options in a single pass. Keys and values are copied into CmdlineStorage, and
+ * options starting with CMDLINE_LOADER_PREFIX are removed from CmdLine, which is compacted in place.
+ */
+void CmdlineParse(char *CmdLine) {
+    char *Read = CmdLine;
+    char *Write = CmdLine;
+    char *Store = CmdlineStorage;
+
+    CmdlineOptionCount = 0;
+    CmdlineLoaderOptions = 0;
+    CmdLine[MACH_CMDLINE - 1] = '\0';
+
+    while (*Read != '\0') {
+        if (CmdlineIsSpace(*Read)) {
+            Read++;
+            continue;
+        }
+
+        char *Token = Read;
+        char *Key = Store;
+        char *Value = NULL;
+        bool Quoted = FALSE;
+
+        for (; *Read != '\0' && (Quoted || !CmdlineIsSpace(*Read)); Read++) {
+            if (*Read == '"') {
+                Quoted = !Quoted;
+            } else if (*Read == '=' && Value == NULL && !Quoted) {
+                *Store++ = '\0';
+                Value = Store;
+            } else {
+                *Store++ = *Read;
+            }
+        }
+        *Store++ = '\0';
+
+        bool Loader = strncmp(Key, CMDLINE_LOADER_PREFIX, sizeof(CMDLINE_LOADER_PREFIX) - 1) == 0;
+        if (CmdlineOptionCount < CMDLINE_MAX_OPTIONS) {
+            CmdlineOptions[CmdlineOptionCount].Key = Key;
+            CmdlineOptions[CmdlineOptionCount].Value = Value;
+            CmdlineOptions[CmdlineOptionCount].Loader = Loader;
+            CmdlineOptionCount++;
+        } else if (Loader) {
+            warn("Too many command line options, ignoring %s\n", Key);
+        }
+
+        if (Loader) {
+            CmdlineLoaderOptions++;
+        } else {
+            /* Keep the option for Linux; Write never passes Token, so copying forward is safe */
+            if (Write != CmdLine) {
+                *Write++ = ' ';
+            }
+            while (Token < Read) {
+                *Write++ = *Token++;
+            }
+        }
+    }
+    *Write = '\0';
+}
+
+/* Find an option by key. The last occurrence wins, like in Linux. */
+PCMDLINE_OPTION CmdlineFind(const char *Key) {
+    for (u32 i = CmdlineOptionCount; i > 0; i--) {
+        if (CmdlineEquals(CmdlineOptions[i - 1].Key, Key)) {
+            return &CmdlineOptions[i - 1];
+        }
+    }
+    return NULL;
+}
+
+u32 CmdlineLoaderOptionCount() {
+    return CmdlineLoaderOptions;
+}
+
+const char *CmdlineGetString(const char *Key, const char *Default) {
+    PCMDLINE_OPTION Option = CmdlineFind(Key);
+
+    if (Option == NULL || Option->Value == NULL || Option->Value[0] == '\0') {
+        return Default;
+    }
+    return Option->Value;
+}
+
+u32 CmdlineGetNumber(const char *Key, u32 Default) {
+    const char *Value = CmdlineGetString(Key, NULL);
+    char *End;
+
+    if (Value == NULL) {
+        return Default;
+    }
+    u32 Number = simple_strtoul(Value, &End, 0);
+    if (*End != '\0') {
+        warn("Ignoring %s=%s, not a number\n", Key, Value);
+        return Default;
+    }
+    return Number;
+}
+
+/* A bare key means TRUE */
+bool CmdlineGetBool(const char *Key, bool Default) {
+    PCMDLINE_OPTION Option = CmdlineFind(Key);
+
+    if (Option == NULL) {
+        return Default;
+    }
+    if (Option->Value == NULL || CmdlineEquals(Option->Value, "1") || CmdlineEquals(Option->Value, "y") ||
+        CmdlineEquals(Option->Value, "yes") || CmdlineEquals(Option->Value, "on")) {
+        return TRUE;
+    }
+    if (CmdlineEquals(Option->Value, "0") || CmdlineEquals(Option->Value, "n") ||
+        CmdlineEquals(Option->Value, "no") || CmdlineEquals(Option->Value, "off")) {
+        return FALSE;
+    }
+    warn("Ignoring %s=%s, not a boolean\n", Key, Option->Value);
+    return Default;
+}
+
+/* Check whether a comma separated list contains Item */
+bool CmdlineListContains(const char *List, const char *Item) {
+    u32 Length = strlen(Item);
+
+    while (*List != '\0') {
+        const char *End = List;
+        while (*End != '\0' && *End != ',') {
+            End++;
+        }
+        if (End - List == Length && strncmp(List, Item, Length) == 0) {
+            return TRUE;
+        }
+        List = (*End == ',') ? End + 1 : End;
+    }
+    return FALSE;
+}
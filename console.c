@@ -21,6 +21,12 @@ volatile u32 VideoCursorX;
 volatile u32 VideoCursorY;
 bool WrapperVerbose;
 u32 NeedsWrapAround;
+char LoaderLog[LOADER_LOG_SIZE];
+u32 LoaderLogLength;
+u32 LogSinks = LOG_SINK_SCREEN | LOG_SINK_SERIAL | LOG_SINK_MEMORY;
+bool SplashActive;
+u32 SplashBarX;
+u32 SplashBarY;
 
 /* FUNCTIONS ******************************************************************/
 
@@ -42,6 +48,24 @@ void PlacePixel(u32 PixelLocationX, u32 PixelLocationY, u32 RgbaValue) {
     PixelStartingAddr[Reserved] = ReservedValue;
 }
 
+/* Fill a horizontal span of pixels */
+static inline
+void FillSpan(u32 *Destination, u32 Color, u32 Count) {
+    __asm__ __volatile__ ( "rep stosl" : "+D"(Destination), "+c"(Count) : "a"(Color) : "memory" );
+}
+
+/* Copy a horizontal span of pixels */
+static inline
+void CopySpan(u32 *Destination, const u32 *Source, u32 Count) {
+    __asm__ __volatile__ ( "rep movsl" : "+D"(Destination), "+S"(Source), "+c"(Count) : : "memory" );
+}
+
+/* Address of the first pixel of a row */
+static inline
+u32 *RowAddress(u32 Row) {
+    return (u32 *) (BootArgs->Video.BaseAddress + (Row * BootArgs->Video.Pitch));
+}
+
 /* Place character on screen */
 static
 void PlaceCharacter(char Character, u32 StartingPositionX, u32 StartingPositionY,
@@ -88,14 +112,32 @@ void PrintToScreen(const char *szBuffer) {
     }
 }
 
-/* Print to serial port */
-static
-void PrintToSerial(const char *szBuffer) {
+/* Write to the serial port regardless of atvloader.log */
+void SerialWrite(const char *szBuffer) {
     for (int i = 0; szBuffer[i] != '\0'; i++) {
         outb(COM1, szBuffer[i]);
     }
 }
 
+/* Print to serial port */
+void PrintToSerial(const char *szBuffer) {
+    if (!(LogSinks & LOG_SINK_SERIAL)) {
+        return;
+    }
+    SerialWrite(szBuffer);
+}
+
+/* Append to the in-memory loader log */
+static
+void PrintToLog(const char *szBuffer) {
+    if (!(LogSinks & LOG_SINK_MEMORY)) {
+        return;
+    }
+    for (int i = 0; szBuffer[i] != '\0' && LoaderLogLength < LOADER_LOG_SIZE; i++) {
+        LoaderLog[LoaderLogLength++] = szBuffer[i];
+    }
+}
+
 /* Change screen colors */
 void ChangeColors(u32 Foreground, u32 Background) {
     TextForegroundColor = Foreground;
@@ -128,20 +170,131 @@ void SetupScreen() {
     PrintToSerial("\n");
 }
 
-/* print always */
-void printf(const char *szFormat, ...) {
+/* Format a message once and hand it to the sinks in Sinks that atvloader.log left enabled */
+static
+void PrintToSinks(u32 Sinks, const char *szFormat, va_list argList) {
     char szBuffer[512 * 2];
     u16 wLength = 0;
-    va_list argList;
 
-    va_start(argList, szFormat);
-    wLength = (u16) vsprintf(szBuffer, szFormat, argList);
-    va_end(argList);
+    /* nobody would see it; debug_printf() on a boot without the memory log ends up here */
+    Sinks &= LogSinks;
+    if (Sinks == 0) {
+        return;
+    }
 
+    wLength = (u16) vsprintf(szBuffer, szFormat, argList);
     szBuffer[sizeof(szBuffer) - 1] = 0;
     if (wLength > (sizeof(szBuffer) - 1))
         wLength = sizeof(szBuffer) - 1;
     szBuffer[wLength] = '\0';
-    PrintToScreen(szBuffer);
-    PrintToSerial(szBuffer);
-}
\ No newline at end of file
+    if (Sinks & LOG_SINK_SCREEN) {
+        PrintToScreen(szBuffer);
+    }
+    if (Sinks & LOG_SINK_SERIAL) {
+        SerialWrite(szBuffer);
+    }
+    if (Sinks & LOG_SINK_MEMORY) {
+        PrintToLog(szBuffer);
+    }
+}
+
+/* print always */
+void printf(const char *szFormat, ...) {
+    va_list argList;
+
+    va_start(argList, szFormat);
+    PrintToSinks(LOG_SINK_SCREEN | LOG_SINK_SERIAL | LOG_SINK_MEMORY, szFormat, argList);
+    va_end(argList);
+}
+
+/* print to the loader log only */
+void LogPrintf(const char *szFormat, ...) {
+    va_list argList;
+
+    va_start(argList, szFormat);
+    PrintToSinks(LOG_SINK_MEMORY, szFormat, argList);
+    va_end(argList);
+}
+
+/* Draw the pre-converted boot logo, if it fits and is valid; stops at the first run that is cut off */
+static
+void SplashDrawLogo(PSPLASH_HEADER Logo, u32 Length, u32 X, u32 Y) {
+    if (Length < sizeof(SPLASH_HEADER) || Logo->Magic != SPLASH_MAGIC ||
+        Logo->RunBytes > Length - sizeof(SPLASH_HEADER)) {
+        return;
+    }
+
+    const u32 *Run = (const u32 *) (Logo + 1);
+    const u32 *End = Run + (Logo->RunBytes / sizeof(u32));
+
+    for (u32 Row = 0; Row < Logo->Height; Row++) {
+        u32 *Pixel = RowAddress(Y + Row) + X;
+        u32 Column = 0;
+
+        while (Column < Logo->Width && Run < End) {
+            u32 Count = *Run & ~SPLASH_RUN_LITERAL;
+
+            if (Count > Logo->Width - Column) {
+                return;
+            }
+            if (*Run & SPLASH_RUN_LITERAL) {
+                if (Count > (u32) (End - Run) - 1) {
+                    return;
+                }
+                CopySpan(Pixel, Run + 1, Count);
+                Run += 1 + Count;
+            } else {
+                if (End - Run < 2) {
+                    return;
+                }
+                /* the screen was just cleared to the background */
+                if (Run[1] != SPLASH_BACKGROUND) {
+                    FillSpan(Pixel, Run[1], Count);
+                }
+                Run += 2;
+            }
+            Pixel += Count;
+            Column += Count;
+        }
+    }
+}
+
+/* Replace the screen with the boot logo and an empty progress bar; used when not booting verbose */
+void SplashInit() {
+    u32 Width = BootArgs->Video.Pitch / 4; // Video.Width is not always correct
+    u32 Height = BootArgs->Video.Height;
+    u32 Length = 0;
+    PSPLASH_HEADER Logo = (PSPLASH_HEADER) GetSectionDataFromHeader(&_mh_execute_header, "__TEXT", "__splash",
+                                                                    &Length);
+    u32 LogoHeight = 0;
+
+    for (u32 Row = 0; Row < Height; Row++) {
+        FillSpan(RowAddress(Row), SPLASH_BACKGROUND, Width);
+    }
+
+    if (Length >= sizeof(SPLASH_HEADER) && Logo->Width <= Width &&
+        Logo->Height + SPLASH_BAR_GAP + SPLASH_BAR_HEIGHT <= Height) {
+        LogoHeight = Logo->Height;
+        SplashDrawLogo(Logo, Length, (Width - Logo->Width) / 2,
+                       (Height - (LogoHeight + SPLASH_BAR_GAP + SPLASH_BAR_HEIGHT)) / 2);
+    }
+
+    SplashBarX = (Width - SPLASH_BAR_WIDTH) / 2;
+    SplashBarY = ((Height - (LogoHeight + SPLASH_BAR_GAP + SPLASH_BAR_HEIGHT)) / 2) + LogoHeight + SPLASH_BAR_GAP;
+    for (u32 Row = 0; Row < SPLASH_BAR_HEIGHT; Row++) {
+        FillSpan(RowAddress(SplashBarY + Row) + SplashBarX, SPLASH_BAR_EMPTY, SPLASH_BAR_WIDTH);
+    }
+    SplashActive = TRUE;
+}
+
+/* Advance the progress bar to the given phase */
+void SplashProgress(u32 Phase) {
+    u32 Filled = (SPLASH_BAR_WIDTH * Phase) / SplashPhaseLinux;
+
+    if (!SplashActive) {
+        return;
+    }
+    for (u32 Row = 0; Row < SPLASH_BAR_HEIGHT; Row++) {
+        FillSpan(RowAddress(SplashBarY + Row) + SplashBarX, SPLASH_BAR_FULL, Filled);
+    }
+}
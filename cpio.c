@@ -0,0 +1,119 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Loader-generated initramfs appended to the initrd for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+static u8 *CpioPosition;
+static u8 *CpioEnd;
+static u32 CpioInode;
+static char CpioTimeline[TIMELINE_MAX_MARKS * 80];
+
+/* FUNCTIONS ******************************************************************/
+
+/* Write a 32-bit value as 8 hex digits, as required by the newc format */
+static
+void CpioPutHex(char *Destination, u32 Value) {
+    static const char HexDigits[] = "0123456789ABCDEF";
+
+    for (int i = 7; i >= 0; i--) {
+        Destination[i] = HexDigits[Value & 0xF];
+        Value >>= 4;
+    }
+}
+
+/* Add a single entry to the archive. Returns FALSE if it does not fit. */
+static
+bool CpioAddEntry(const char *Name, u32 Mode, const void *Data, u32 Size) {
+    u32 NameSize = strlen(Name) + 1;
+    u32 HeaderSize = CPIO_ALIGN(CPIO_NEWC_HEADER_SIZE + NameSize);
+    u32 Fields[13] = {
+            ++CpioInode,    /* c_ino */
+            Mode,           /* c_mode */
+            0,              /* c_uid */
+            0,              /* c_gid */
+            1,              /* c_nlink */
+            0,              /* c_mtime */
+            Size,           /* c_filesize */
+            0, 0,           /* c_devmajor, c_devminor */
+            0, 0,           /* c_rdevmajor, c_rdevminor */
+            NameSize,       /* c_namesize */
+            0,              /* c_check */
+    };
+
+    if (HeaderSize + CPIO_ALIGN(Size) > (u32) (CpioEnd - CpioPosition)) {
+        warn("No room for %s in the loader initramfs!\n", Name);
+        return FALSE;
+    }
+
+    /* header and name, padded so the data starts on a 4-byte boundary */
+    memset(CpioPosition, 0, HeaderSize);
+    memcpy(CpioPosition, CPIO_NEWC_MAGIC, 6);
+    for (int i = 0; i < 13; i++) {
+        CpioPutHex((char *) CpioPosition + 6 + (i * 8), Fields[i]);
+    }
+    memcpy(CpioPosition + CPIO_NEWC_HEADER_SIZE, Name, NameSize);
+    CpioPosition += HeaderSize;
+
+    /* file data, padded so the next header starts on a 4-byte boundary */
+    if (Size != 0) {
+        memcpy(CpioPosition, Data, Size);
+        memset(CpioPosition + Size, 0, CPIO_ALIGN(Size) - Size);
+        CpioPosition += CPIO_ALIGN(Size);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Generate a newc cpio with loader information directly after the initrd, so Linux unpacks it on top of the
+ * initrd without any extra copies. Reserve is the space behind the initrd: the __PAYLOAD,__cpio section, which the
+ * linker places right after __PAYLOAD,__initrd, or the memory allocated past an initrd loaded from disk.
+ */
+void AppendLoaderCpio(const u8 **InitrdPtr, u32 *InitrdLen, u8 *Reserve, u32 ReserveLength) {
+    u8 *InitrdEnd = (u8 *) *InitrdPtr + *InitrdLen;
+    u8 *CpioStart;
+
+    if (*InitrdLen == 0) {
+        /* the loader initramfs is the only one */
+        CpioStart = Reserve;
+    } else if (Reserve >= InitrdEnd) {
+        /* Linux skips zeroes between archives, but only looks for headers on 4-byte boundaries */
+        CpioStart = (u8 *) *InitrdPtr + CPIO_ALIGN((u32) (Reserve - *InitrdPtr));
+        memset(InitrdEnd, 0, CpioStart - InitrdEnd);
+    } else {
+        warn("Loader initramfs reserve is not after the initrd, skipping.\n");
+        return;
+    }
+
+    CpioPosition = CpioStart;
+    CpioEnd = Reserve + ReserveLength;
+    CpioInode = 0;
+
+    if (!CpioAddEntry(CPIO_LOADER_DIRECTORY, CPIO_MODE_DIRECTORY, NULL, 0)) {
+        return;
+    }
+    CpioAddEntry(CPIO_LOADER_DIRECTORY "/cmdline", CPIO_MODE_FILE, BootArgs->CmdLine, strlen(BootArgs->CmdLine));
+    if (BootArgs->DeviceTreeLength != 0) {
+        CpioAddEntry(CPIO_LOADER_DIRECTORY "/devicetree", CPIO_MODE_FILE, (void *) BootArgs->DeviceTree,
+                     BootArgs->DeviceTreeLength);
+    }
+    CpioAddEntry(CPIO_LOADER_DIRECTORY "/timeline", CPIO_MODE_FILE, CpioTimeline,
+                 TimelineFormat(CpioTimeline, sizeof(CpioTimeline)));
+    /* log goes last so it contains everything printed while building the archive */
+    CpioAddEntry(CPIO_LOADER_DIRECTORY "/log", CPIO_MODE_FILE, LoaderLog, LoaderLogLength);
+    CpioAddEntry("TRAILER!!!", 0, NULL, 0);
+
+    if (*InitrdLen == 0) {
+        *InitrdPtr = CpioStart;
+    }
+    *InitrdLen = CpioPosition - *InitrdPtr;
+    trace("Loader initramfs is %u bytes at 0x%X.\n", CpioPosition - CpioStart, CpioStart);
+}
@@ -0,0 +1,437 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Polled EHCI USB host controller driver for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+#define EhciRead(Reg)           (*(volatile u32 *) (EhciOperational + (Reg)))
+#define EhciWrite(Reg, Value)   (*(volatile u32 *) (EhciOperational + (Reg)) = (Value))
+#define EhciBarrier()           __asm__ __volatile__ ("" : : : "memory")
+
+static u8 *EhciOperational;
+
+/* Dummy head of the asynchronous schedule plus one QH per pipe */
+static EHCI_QH EhciAsyncHead;
+static EHCI_QH EhciQhPool[EHCI_QH_COUNT];
+static u32 EhciQhUsed;
+
+/* Only one batch of transfers is in flight at a time, so qTDs are handed out linearly */
+static EHCI_QTD EhciQtdPool[EHCI_QTD_COUNT];
+static u32 EhciQtdUsed;
+
+static USB_DEVICE EhciDevices[EHCI_MAX_DEVICES];
+static u32 EhciDeviceCount;
+
+/* FUNCTIONS ******************************************************************/
+
+/* Wait until (register & Mask) == Value */
+static
+bool EhciWaitRegister(u32 Register, u32 Mask, u32 Value, int TimeoutMs) {
+    int Timeout = mseconds() + TimeoutMs;
+
+    while ((EhciRead(Register) & Mask) != Value) {
+        if (mseconds() > Timeout) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void EhciFreeQtds() {
+    EhciQtdUsed = 0;
+}
+
+/*
+ * Build a chain of qTDs describing one transfer. Each qTD covers as much as its five buffer pages allow,
+ * rounded down to whole packets, so large reads need only a handful of descriptors.
+ */
+PEHCI_QTD EhciBuildChain(u8 Pid, void *Data, u32 Length, PEHCI_QTD Next, PEHCI_QTD AltNext,
+                         PEHCI_QTD *Last) {
+    PEHCI_QTD First = NULL, Previous = NULL, Qtd;
+    u32 Address = (u32) Data;
+
+    do {
+        u32 Size = (5 * 4096) - (Address & 0xFFF);
+
+        if (EhciQtdUsed == EHCI_QTD_COUNT) {
+            error("Out of EHCI transfer descriptors!\n");
+            return NULL;
+        }
+        Qtd = &EhciQtdPool[EhciQtdUsed++];
+
+        if (Size >= Length) {
+            Size = Length;
+        } else {
+            Size &= ~511;
+        }
+
+        Qtd->Next = EHCI_TERMINATE;
+        Qtd->AltNext = AltNext ? (u32) AltNext : EHCI_TERMINATE;
+        Qtd->Buffer[0] = Address;
+        for (int i = 1; i < 5; i++) {
+            Qtd->Buffer[i] = (Address & ~0xFFF) + (i * 4096);
+        }
+        for (int i = 0; i < 5; i++) {
+            Qtd->BufferHigh[i] = 0;
+        }
+        Qtd->Token = (Size << 16) | EHCI_TOKEN_CERR | (Pid << 8) | EHCI_TOKEN_ACTIVE;
+
+        if (Previous) {
+            Previous->Next = (u32) Qtd;
+        } else {
+            First = Qtd;
+        }
+        Previous = Qtd;
+        Address += Size;
+        Length -= Size;
+    } while (Length != 0);
+
+    if (Next) {
+        Qtd->Next = (u32) Next;
+    }
+    *Last = Qtd;
+    return First;
+}
+
+/* Hand a chain to an idle pipe. The controller picks it up on its next pass through the schedule. */
+void EhciSubmit(PEHCI_QH Pipe, PEHCI_QTD First) {
+    EhciBarrier();
+    Pipe->AltNext = EHCI_TERMINATE;
+    /* keep the data toggle, drop a halted state left over from an earlier error */
+    Pipe->Token &= EHCI_TOKEN_TOGGLE;
+    EhciBarrier();
+    Pipe->Next = (u32) First;
+}
+
+/* Explain why a qTD halted; a halt without any error bit is a STALL from the device */
+static
+void EhciReportHalt(u32 Token) {
+    debug_printf("EHCI transfer halted:%s%s%s%s%s\n",
+                 (Token & EHCI_TOKEN_BUFFER_ERROR) ? " buffer error" : "",
+                 (Token & EHCI_TOKEN_BABBLE) ? " babble" : "",
+                 (Token & EHCI_TOKEN_XACT_ERROR) ? " transaction error" : "",
+                 (Token & EHCI_TOKEN_MISSED_UFRAME) ? " missed microframe" : "",
+                 (Token & (EHCI_TOKEN_BUFFER_ERROR | EHCI_TOKEN_BABBLE | EHCI_TOKEN_XACT_ERROR |
+                           EHCI_TOKEN_MISSED_UFRAME)) ? "" : " stall");
+}
+
+/* Wait for the last qTD of a chain to retire. Only a halt fails the transfer. */
+bool EhciWait(PEHCI_QH Pipe, PEHCI_QTD Last) {
+    int Timeout = mseconds() + EHCI_TIMEOUT_MS;
+
+    while (Last->Token & EHCI_TOKEN_ACTIVE) {
+        if (Pipe->Token & EHCI_TOKEN_HALTED) {
+            /* take the rest of the chain off the pipe */
+            Pipe->Next = EHCI_TERMINATE;
+            EhciReportHalt(Pipe->Token);
+            return FALSE;
+        }
+        if (mseconds() > Timeout) {
+            Pipe->Next = EHCI_TERMINATE;
+            debug_printf("EHCI transfer timed out\n");
+            return FALSE;
+        }
+    }
+    if (Last->Token & EHCI_TOKEN_HALTED) {
+        EhciReportHalt(Last->Token);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Allocate a QH and link it into the running asynchronous schedule */
+PEHCI_QH EhciOpenPipe(u8 Address, u8 Endpoint, u16 MaxPacket, bool Control) {
+    PEHCI_QH Pipe;
+
+    if (EhciQhUsed == EHCI_QH_COUNT) {
+        error("Out of EHCI queue heads!\n");
+        return NULL;
+    }
+    Pipe = &EhciQhPool[EhciQhUsed++];
+    memset((void *) Pipe, 0, sizeof(EHCI_QH));
+
+    Pipe->Characteristics = EHCI_QH_NAK_RELOAD | (MaxPacket << 16) | EHCI_QH_EPS_HIGH |
+                            ((Endpoint & 0xF) << 8) | Address;
+    if (Control) {
+        Pipe->Characteristics |= EHCI_QH_DTC;
+    }
+    Pipe->Capabilities = EHCI_QH_MULT_1;
+    Pipe->Next = EHCI_TERMINATE;
+    Pipe->AltNext = EHCI_TERMINATE;
+
+    Pipe->HorizontalLink = EhciAsyncHead.HorizontalLink;
+    EhciBarrier();
+    EhciAsyncHead.HorizontalLink = (u32) Pipe | EHCI_TYPE_QH;
+    return Pipe;
+}
+
+static
+bool EhciControl(PEHCI_QH Pipe, PUSB_SETUP_PACKET Setup, void *Data) {
+    static USB_SETUP_PACKET SetupBuffer __aligned(32);
+    PEHCI_QTD First, Last, Status, DataFirst = NULL, DataLast, SetupLast;
+    bool In = (Setup->RequestType & USB_DIR_IN) != 0;
+
+    SetupBuffer = *Setup;
+    EhciFreeQtds();
+
+    /* status stage goes the opposite way of the data stage and always uses DATA1 */
+    Status = EhciBuildChain(In && Setup->Length ? EHCI_TOKEN_PID_OUT : EHCI_TOKEN_PID_IN, NULL, 0, NULL, NULL, &Last);
+    if (!Status) {
+        return FALSE;
+    }
+    Status->Token |= EHCI_TOKEN_TOGGLE | EHCI_TOKEN_IOC;
+
+    if (Setup->Length) {
+        DataFirst = EhciBuildChain(In ? EHCI_TOKEN_PID_IN : EHCI_TOKEN_PID_OUT, Data, Setup->Length,
+                                   Status, Status, &DataLast);
+        if (!DataFirst) {
+            return FALSE;
+        }
+        DataFirst->Token |= EHCI_TOKEN_TOGGLE;
+    }
+
+    First = EhciBuildChain(EHCI_TOKEN_PID_SETUP, &SetupBuffer, sizeof(USB_SETUP_PACKET),
+                           DataFirst ? DataFirst : Status, NULL, &SetupLast);
+    if (!First) {
+        return FALSE;
+    }
+
+    EhciSubmit(Pipe, First);
+    return EhciWait(Pipe, Last);
+}
+
+bool EhciControlTransfer(PUSB_DEVICE Device, PUSB_SETUP_PACKET Setup, void *Data) {
+    return EhciControl(Device->Control, Setup, Data);
+}
+
+/* Clear a stalled endpoint and reset its data toggle */
+bool EhciClearHalt(PUSB_DEVICE Device, PEHCI_QH Pipe, u8 EndpointAddress) {
+    USB_SETUP_PACKET Setup = { USB_RECIP_ENDPOINT, USB_REQ_CLEAR_FEATURE, USB_FEATURE_ENDPOINT_HALT,
+                               EndpointAddress, 0 };
+
+    Pipe->Next = EHCI_TERMINATE;
+    Pipe->Token = 0;
+    return EhciControlTransfer(Device, &Setup, NULL);
+}
+
+/* Reset a root port. Returns TRUE if a high speed device is now enabled on it. */
+static
+bool EhciResetPort(u32 Port) {
+    u32 Status = EhciRead(EHCI_PORTSC(Port));
+
+    if (!(Status & EHCI_PORT_CCS)) {
+        return FALSE;
+    }
+    /* low speed devices belong to the companion controller */
+    if ((Status & EHCI_PORT_LS_MASK) == EHCI_PORT_LS_K) {
+        EhciWrite(EHCI_PORTSC(Port), (Status & ~EHCI_PORT_RWC) | EHCI_PORT_OWNER);
+        return FALSE;
+    }
+
+    Status &= ~(EHCI_PORT_PE | EHCI_PORT_RWC);
+    EhciWrite(EHCI_PORTSC(Port), Status | EHCI_PORT_PR);
+    msleep(50);
+    EhciWrite(EHCI_PORTSC(Port), Status & ~EHCI_PORT_PR);
+    if (!EhciWaitRegister(EHCI_PORTSC(Port), EHCI_PORT_PR, 0, 10)) {
+        return FALSE;
+    }
+
+    /* so do full speed devices, which show up as not enabled after reset */
+    Status = EhciRead(EHCI_PORTSC(Port));
+    if (!(Status & EHCI_PORT_PE)) {
+        EhciWrite(EHCI_PORTSC(Port), (Status & ~EHCI_PORT_RWC) | EHCI_PORT_OWNER);
+        return FALSE;
+    }
+    /* reset recovery */
+    msleep(10);
+    return TRUE;
+}
+
+/* Address and configure the device on a freshly reset port */
+static
+bool EhciEnumerate(PEHCI_QH DefaultPipe, u32 Port) {
+    PUSB_DEVICE Device = &EhciDevices[EhciDeviceCount];
+    PUSB_CONFIG_DESCRIPTOR Config = (PUSB_CONFIG_DESCRIPTOR) Device->Config;
+    u8 Address = EhciDeviceCount + 1;
+    USB_SETUP_PACKET Setup;
+
+    memset(Device, 0, sizeof(USB_DEVICE));
+    Device->Port = Port;
+    Device->Control = DefaultPipe;
+
+    Setup = (USB_SETUP_PACKET) { USB_DIR_IN, USB_REQ_GET_DESCRIPTOR, USB_DT_DEVICE << 8, 0,
+                                 sizeof(USB_DEVICE_DESCRIPTOR) };
+    if (!EhciControlTransfer(Device, &Setup, &Device->Descriptor)) {
+        return FALSE;
+    }
+
+    Setup = (USB_SETUP_PACKET) { 0, USB_REQ_SET_ADDRESS, Address, 0, 0 };
+    if (!EhciControlTransfer(Device, &Setup, NULL)) {
+        return FALSE;
+    }
+    msleep(2);
+    Device->Address = Address;
+    Device->Control = EhciOpenPipe(Address, 0, Device->Descriptor.MaxPacketSize0, TRUE);
+    if (!Device->Control) {
+        return FALSE;
+    }
+
+    /* header first to learn the total length */
+    Setup = (USB_SETUP_PACKET) { USB_DIR_IN, USB_REQ_GET_DESCRIPTOR, USB_DT_CONFIG << 8, 0,
+                                 sizeof(USB_CONFIG_DESCRIPTOR) };
+    if (!EhciControlTransfer(Device, &Setup, Device->Config)) {
+        return FALSE;
+    }
+    Device->ConfigLength = (Config->TotalLength < USB_CONFIG_MAX) ? Config->TotalLength : USB_CONFIG_MAX;
+    Setup.Length = Device->ConfigLength;
+    if (!EhciControlTransfer(Device, &Setup, Device->Config)) {
+        return FALSE;
+    }
+
+    Setup = (USB_SETUP_PACKET) { 0, USB_REQ_SET_CONFIGURATION, Config->ConfigurationValue, 0, 0 };
+    if (!EhciControlTransfer(Device, &Setup, NULL)) {
+        return FALSE;
+    }
+
+    debug_printf("USB device %04X:%04X at address %u on port %u\n", Device->Descriptor.VendorId,
+                 Device->Descriptor.ProductId, Address, Port);
+    EhciDeviceCount++;
+    return TRUE;
+}
+
+/* Take the controller from the firmware if it still holds it */
+static
+void EhciTakeOwnership(u8 Device, u8 Function, u32 HccParams) {
+    u8 Eecp = (HccParams >> 8) & 0xFF;
+
+    while (Eecp >= 0x40) {
+        u32 LegacySupport = PciConfigRead32(0, Device, Function, Eecp);
+
+        if ((LegacySupport & 0xFF) == EHCI_LEGSUP_ID) {
+            int Timeout = mseconds() + 1000;
+
+            PciConfigWrite32(0, Device, Function, Eecp, LegacySupport | EHCI_LEGSUP_OS_OWNED);
+            while (PciConfigRead32(0, Device, Function, Eecp) & EHCI_LEGSUP_BIOS_OWNED) {
+                if (mseconds() > Timeout) {
+                    warn("Firmware did not release the EHCI controller.\n");
+                    break;
+                }
+            }
+            /* no SMIs from here on */
+            PciConfigWrite32(0, Device, Function, Eecp + 4, 0);
+            return;
+        }
+        Eecp = (LegacySupport >> 8) & 0xFF;
+    }
+}
+
+/*
+ * Reset the first EHCI controller, start the asynchronous schedule and enumerate the high speed devices on its
+ * root ports. Hubs are not supported. Returns the number of devices found.
+ */
+u32 EhciInit() {
+    u8 Device, Function;
+    u8 *Capabilities;
+    u32 HcsParams, Ports;
+    PEHCI_QH DefaultPipe;
+
+    EhciDeviceCount = 0;
+    EhciQhUsed = 0;
+    EhciFreeQtds();
+
+    if (!PciFindClass(0x0C, 0x03, 0, &Device, &Function)) {
+        return 0;
+    }
+    /* the USB controller class is shared by UHCI, OHCI and EHCI; keep looking for prog-if 0x20 */
+    for (u32 Index = 1; ((PciConfigRead32(0, Device, Function, PCI_CLASS_REVISION) >> 8) & 0xFF) != 0x20; Index++) {
+        if (!PciFindClass(0x0C, 0x03, Index, &Device, &Function)) {
+            return 0;
+        }
+    }
+
+    PciConfigWrite32(0, Device, Function, PCI_COMMAND,
+                     (PciConfigRead32(0, Device, Function, PCI_COMMAND) & 0xFFFF) |
+                     PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+    Capabilities = (u8 *) (PciConfigRead32(0, Device, Function, PCI_BAR0) & ~0xF);
+    EhciOperational = Capabilities + *(volatile u8 *) (Capabilities + EHCI_CAPLENGTH);
+    HcsParams = *(volatile u32 *) (Capabilities + EHCI_HCSPARAMS);
+    Ports = HcsParams & 0xF;
+
+    EhciTakeOwnership(Device, Function, *(volatile u32 *) (Capabilities + EHCI_HCCPARAMS));
+
+    /* stop and reset */
+    EhciWrite(EHCI_USBCMD, EhciRead(EHCI_USBCMD) & ~EHCI_CMD_RUN);
+    EhciWaitRegister(EHCI_USBSTS, EHCI_STS_HCHALTED, EHCI_STS_HCHALTED, 20);
+    EhciWrite(EHCI_USBCMD, EHCI_CMD_HCRESET);
+    if (!EhciWaitRegister(EHCI_USBCMD, EHCI_CMD_HCRESET, 0, 250)) {
+        error("EHCI controller did not reset!\n");
+        return 0;
+    }
+
+    /* an idle head QH that only links to itself until pipes are opened */
+    memset((void *) &EhciAsyncHead, 0, sizeof(EHCI_QH));
+    EhciAsyncHead.HorizontalLink = (u32) &EhciAsyncHead | EHCI_TYPE_QH;
+    EhciAsyncHead.Characteristics = EHCI_QH_HEAD | EHCI_QH_EPS_HIGH | (64 << 16);
+    EhciAsyncHead.Capabilities = EHCI_QH_MULT_1;
+    EhciAsyncHead.Next = EHCI_TERMINATE;
+    EhciAsyncHead.AltNext = EHCI_TERMINATE;
+    EhciAsyncHead.Token = EHCI_TOKEN_HALTED;
+
+    EhciWrite(EHCI_USBINTR, 0);
+    EhciWrite(EHCI_CTRLDSSEGMENT, 0);
+    EhciWrite(EHCI_ASYNCLISTADDR, (u32) &EhciAsyncHead);
+    EhciWrite(EHCI_USBCMD, EHCI_CMD_ITC_1MS | EHCI_CMD_ASE | EHCI_CMD_RUN);
+    EhciWrite(EHCI_CONFIGFLAG, 1);
+    if (!EhciWaitRegister(EHCI_USBSTS, EHCI_STS_ASS, EHCI_STS_ASS, 20)) {
+        error("EHCI asynchronous schedule did not start!\n");
+        return 0;
+    }
+
+    if (HcsParams & EHCI_HCSPARAMS_PPC) {
+        for (u32 Port = 0; Port < Ports; Port++) {
+            EhciWrite(EHCI_PORTSC(Port), (EhciRead(EHCI_PORTSC(Port)) & ~EHCI_PORT_RWC) | EHCI_PORT_PP);
+        }
+    }
+    /* power good and port routing */
+    msleep(20);
+
+    DefaultPipe = EhciOpenPipe(0, 0, 64, TRUE);
+    for (u32 Port = 0; Port < Ports && EhciDeviceCount < EHCI_MAX_DEVICES; Port++) {
+        if (EhciResetPort(Port) && !EhciEnumerate(DefaultPipe, Port)) {
+            warn("Could not enumerate USB device on port %u.\n", Port);
+        }
+    }
+
+    return EhciDeviceCount;
+}
+
+/*
+ * Stop the controller before Linux starts. The schedule lives in loader memory that Linux gets as RAM, and a running
+ * controller would keep fetching (and writing back) whatever ends up there.
+ */
+void EhciShutdown() {
+    if (EhciOperational == NULL) {
+        return;
+    }
+    EhciWrite(EHCI_USBCMD, EhciRead(EHCI_USBCMD) & ~EHCI_CMD_ASE);
+    EhciWaitRegister(EHCI_USBSTS, EHCI_STS_ASS, 0, 20);
+    EhciWrite(EHCI_USBCMD, EhciRead(EHCI_USBCMD) & ~EHCI_CMD_RUN);
+    if (!EhciWaitRegister(EHCI_USBSTS, EHCI_STS_HCHALTED, EHCI_STS_HCHALTED, 20)) {
+        warn("EHCI controller did not halt!\n");
+    }
+    EhciOperational = NULL;
+}
+
+PUSB_DEVICE EhciGetDevice(u32 Index) {
+    if (Index >= EhciDeviceCount) {
+        return NULL;
+    }
+    return &EhciDevices[Index];
+}
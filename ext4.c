@@ -0,0 +1,258 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Read-only ext4 driver for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+#define EXT4_SUPERBLOCK_OFFSET      1024
+#define EXT4_SUPER_MAGIC            0xEF53
+#define EXT4_FEATURE_INCOMPAT_64BIT 0x80
+#define EXT4_ROOT_INODE             2
+#define EXT4_INODE_READ_SIZE        128 /* Everything we need is in the original 128 byte inode */
+
+#define EXT4_S_IFMT                 0xF000
+#define EXT4_S_IFDIR                0x4000
+#define EXT4_EXTENTS_FL             0x80000
+
+#define EXT4_EXTENT_MAGIC           0xF30A
+#define EXT4_EXTENT_MAX_DEPTH       5
+#define EXT4_EXTENT_ENTRY_SIZE      12
+#define EXT4_EXTENT_INIT_MAX_LEN    32768 /* Longer extents are uninitialized and read as zeroes */
+
+typedef struct {
+    PFS_VOLUME Volume;
+    FS_EXTENT_CALLBACK Callback;
+    void *Context;
+    u32 NextBlock; /* File block following the last extent reported */
+    bool Stop; /* Callback asked to stop */
+} EXT4_WALK, *PEXT4_WALK;
+
+typedef struct {
+    PFS_VOLUME Volume;
+    const char *Name;
+    u32 NameLength;
+    u32 Inode; /* Inode of the match, 0 if none */
+    bool Failed;
+} EXT4_LOOKUP, *PEXT4_LOOKUP;
+
+/* FUNCTIONS ******************************************************************/
+
+static
+u64 Ext4BlockOffset(PFS_VOLUME Volume, u64 Block) {
+    return (Volume->StartSector * FS_SECTOR_SIZE) + (Block * Volume->Ext4.BlockSize);
+}
+
+bool Ext4Mount(PFS_VOLUME Volume) {
+    u8 Super[256];
+    u32 LogBlockSize;
+
+    if (!FsCacheRead(Volume->Device, (Volume->StartSector * FS_SECTOR_SIZE) + EXT4_SUPERBLOCK_OFFSET,
+                     Super, sizeof(Super))) {
+        return FALSE;
+    }
+    LogBlockSize = *(u32 *) &Super[0x18];
+    if (*(u16 *) &Super[0x38] != EXT4_SUPER_MAGIC || LogBlockSize > 6 || *(u32 *) &Super[0x28] == 0) {
+        return FALSE;
+    }
+
+    Volume->Type = FsTypeExt4;
+    Volume->Ext4.BlockSize = 1024 << LogBlockSize;
+    Volume->Ext4.SectorsPerBlock = Volume->Ext4.BlockSize / FS_SECTOR_SIZE;
+    Volume->Ext4.InodesPerGroup = *(u32 *) &Super[0x28];
+    /* revision 0 filesystems have fixed 128 byte inodes */
+    Volume->Ext4.InodeSize = *(u32 *) &Super[0x4C] ? *(u16 *) &Super[0x58] : 128;
+    Volume->Ext4.DescriptorSize = 32;
+    if ((*(u32 *) &Super[0x60] & EXT4_FEATURE_INCOMPAT_64BIT) && *(u16 *) &Super[0xFE] > 32) {
+        Volume->Ext4.DescriptorSize = *(u16 *) &Super[0xFE];
+    }
+    Volume->Ext4.DescriptorBlock = *(u32 *) &Super[0x14] + 1;
+    return TRUE;
+}
+
+/* Read the first EXT4_INODE_READ_SIZE bytes of an inode */
+static
+bool Ext4ReadInode(PFS_VOLUME Volume, u32 Inode, u8 *Buffer) {
+    u32 Group = (Inode - 1) / Volume->Ext4.InodesPerGroup;
+    u32 Index = (Inode - 1) % Volume->Ext4.InodesPerGroup;
+    u8 Descriptor[64];
+    u64 InodeTable;
+
+    if (!FsCacheRead(Volume->Device, Ext4BlockOffset(Volume, Volume->Ext4.DescriptorBlock) +
+                                     ((u64) Group * Volume->Ext4.DescriptorSize),
+                     Descriptor, (Volume->Ext4.DescriptorSize >= 64) ? 64 : 32)) {
+        return FALSE;
+    }
+    InodeTable = *(u32 *) &Descriptor[0x08];
+    if (Volume->Ext4.DescriptorSize >= 64) {
+        InodeTable |= (u64) *(u32 *) &Descriptor[0x28] << 32;
+    }
+
+    return FsCacheRead(Volume->Device, Ext4BlockOffset(Volume, InodeTable) + ((u64) Index * Volume->Ext4.InodeSize),
+                       Buffer, EXT4_INODE_READ_SIZE);
+}
+
+static
+bool Ext4OpenInode(PFS_VOLUME Volume, u32 Inode, PFS_FILE File) {
+    u8 Buffer[EXT4_INODE_READ_SIZE];
+
+    if (!Ext4ReadInode(Volume, Inode, Buffer)) {
+        return FALSE;
+    }
+    File->Volume = Volume;
+    File->Id = Inode;
+    File->Size = *(u32 *) &Buffer[0x04] | ((u64) *(u32 *) &Buffer[0x6C] << 32);
+    File->Directory = (*(u16 *) &Buffer[0x00] & EXT4_S_IFMT) == EXT4_S_IFDIR;
+    return TRUE;
+}
+
+bool Ext4Root(PFS_VOLUME Volume, PFS_FILE File) {
+    return Ext4OpenInode(Volume, EXT4_ROOT_INODE, File);
+}
+
+/*
+ * Walk one extent tree node. The root lives in the inode; deeper nodes are read entry by entry through the
+ * block cache so no block-sized buffers end up on the stack.
+ */
+static
+bool Ext4WalkNode(PEXT4_WALK Walk, const u8 *Inline, u64 Offset, u32 Depth) {
+    u8 Entry[EXT4_EXTENT_ENTRY_SIZE];
+    u16 Entries, NodeDepth;
+
+    if (Inline) {
+        memcpy(Entry, Inline, EXT4_EXTENT_ENTRY_SIZE);
+    } else if (!FsCacheRead(Walk->Volume->Device, Offset, Entry, EXT4_EXTENT_ENTRY_SIZE)) {
+        return FALSE;
+    }
+    Entries = *(u16 *) &Entry[2];
+    NodeDepth = *(u16 *) &Entry[6];
+    if (*(u16 *) &Entry[0] != EXT4_EXTENT_MAGIC || NodeDepth > EXT4_EXTENT_MAX_DEPTH || NodeDepth >= Depth) {
+        error("Corrupt ext4 extent tree!\n");
+        return FALSE;
+    }
+
+    for (u32 i = 1; i <= Entries && !Walk->Stop; i++) {
+        if (Inline) {
+            memcpy(Entry, Inline + (i * EXT4_EXTENT_ENTRY_SIZE), EXT4_EXTENT_ENTRY_SIZE);
+        } else if (!FsCacheRead(Walk->Volume->Device, Offset + (i * EXT4_EXTENT_ENTRY_SIZE), Entry,
+                                EXT4_EXTENT_ENTRY_SIZE)) {
+            return FALSE;
+        }
+
+        if (NodeDepth != 0) {
+            /* index entry: ei_block, ei_leaf_lo, ei_leaf_hi */
+            u64 Leaf = *(u32 *) &Entry[4] | ((u64) *(u16 *) &Entry[8] << 32);
+
+            if (!Ext4WalkNode(Walk, NULL, Ext4BlockOffset(Walk->Volume, Leaf), NodeDepth)) {
+                return FALSE;
+            }
+        } else {
+            /* leaf entry: ee_block, ee_len, ee_start_hi, ee_start_lo */
+            u32 Block = *(u32 *) &Entry[0];
+            u32 Length = *(u16 *) &Entry[4];
+            u64 Start = *(u32 *) &Entry[8] | ((u64) *(u16 *) &Entry[6] << 32);
+            u32 SectorsPerBlock = Walk->Volume->Ext4.SectorsPerBlock;
+            bool Uninitialized = Length > EXT4_EXTENT_INIT_MAX_LEN;
+
+            if (Uninitialized) {
+                Length -= EXT4_EXTENT_INIT_MAX_LEN;
+            }
+            if (Block > Walk->NextBlock &&
+                !Walk->Callback(FS_SPARSE, (Block - Walk->NextBlock) * SectorsPerBlock, Walk->Context)) {
+                Walk->Stop = TRUE;
+                break;
+            }
+            if (!Walk->Callback(Uninitialized ? FS_SPARSE
+                                              : Walk->Volume->StartSector + (Start * SectorsPerBlock),
+                                Length * SectorsPerBlock, Walk->Context)) {
+                Walk->Stop = TRUE;
+            }
+            Walk->NextBlock = Block + Length;
+        }
+    }
+    return TRUE;
+}
+
+bool Ext4MapExtents(PFS_FILE File, FS_EXTENT_CALLBACK Callback, void *Context) {
+    u8 Inode[EXT4_INODE_READ_SIZE];
+    EXT4_WALK Walk;
+
+    if (!Ext4ReadInode(File->Volume, File->Id, Inode)) {
+        return FALSE;
+    }
+    if (!(*(u32 *) &Inode[0x20] & EXT4_EXTENTS_FL)) {
+        error("ext4 inode %u does not use extents!\n", File->Id);
+        return FALSE;
+    }
+
+    memset(&Walk, 0, sizeof(EXT4_WALK));
+    Walk.Volume = File->Volume;
+    Walk.Callback = Callback;
+    Walk.Context = Context;
+    /* i_block holds the root node */
+    return Ext4WalkNode(&Walk, &Inode[0x28], 0, EXT4_EXTENT_MAX_DEPTH + 1);
+}
+
+/* Scan a run of directory blocks for a name. Entries never cross a block boundary. */
+static
+bool Ext4ScanDirectory(u64 Sector, u32 Count, void *Context) {
+    PEXT4_LOOKUP Lookup = (PEXT4_LOOKUP) Context;
+    u64 Offset = Sector * FS_SECTOR_SIZE;
+    u64 End = Offset + ((u64) Count * FS_SECTOR_SIZE);
+
+    if (Sector == FS_SPARSE) {
+        return TRUE;
+    }
+    while (Offset < End) {
+        u8 Header[8];
+        char Name[FS_MAX_NAME];
+        u16 RecordLength;
+
+        if (!FsCacheRead(Lookup->Volume->Device, Offset, Header, sizeof(Header))) {
+            Lookup->Failed = TRUE;
+            return FALSE;
+        }
+        RecordLength = *(u16 *) &Header[4];
+        if (RecordLength < 8) {
+            error("Corrupt ext4 directory!\n");
+            Lookup->Failed = TRUE;
+            return FALSE;
+        }
+
+        if (*(u32 *) &Header[0] != 0 && Header[6] == Lookup->NameLength) {
+            if (!FsCacheRead(Lookup->Volume->Device, Offset + 8, Name, Header[6])) {
+                Lookup->Failed = TRUE;
+                return FALSE;
+            }
+            if (memcmp(Name, Lookup->Name, Lookup->NameLength) == 0) {
+                Lookup->Inode = *(u32 *) &Header[0];
+                return FALSE;
+            }
+        }
+        Offset += RecordLength;
+    }
+    return TRUE;
+}
+
+bool Ext4Lookup(PFS_FILE Directory, const char *Name, u32 NameLength, PFS_FILE File) {
+    EXT4_LOOKUP Lookup;
+
+    if (NameLength >= FS_MAX_NAME) {
+        return FALSE;
+    }
+    memset(&Lookup, 0, sizeof(EXT4_LOOKUP));
+    Lookup.Volume = Directory->Volume;
+    Lookup.Name = Name;
+    Lookup.NameLength = NameLength;
+
+    if (!Ext4MapExtents(Directory, Ext4ScanDirectory, &Lookup) || Lookup.Failed || Lookup.Inode == 0) {
+        return FALSE;
+    }
+    return Ext4OpenInode(Directory->Volume, Lookup.Inode, File);
+}
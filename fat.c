@@ -0,0 +1,205 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Read-only FAT32 driver for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+#define FAT_ATTR_VOLUME         0x08
+#define FAT_ATTR_DIRECTORY      0x10
+#define FAT_ATTR_LONG_NAME      0x0F
+#define FAT_ENTRY_FREE          0xE5
+#define FAT_ENTRY_LAST_LFN      0x40
+#define FAT_END_OF_CHAIN        0x0FFFFFF8
+#define FAT_ENTRY_SIZE          32
+
+/* Offsets of the 13 UCS-2 characters in a long name entry */
+static const u8 FatLongNameOffsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+typedef struct {
+    PFS_VOLUME Volume;
+    const char *Name; /* Name being looked up */
+    u32 NameLength;
+    PFS_FILE Result;
+    bool Found;
+    bool Failed;
+    char LongName[FS_MAX_NAME]; /* Long name collected from the entries before a short entry */
+    u32 LongNameLength; /* 0 if there is no long name */
+} FAT_LOOKUP, *PFAT_LOOKUP;
+
+/* FUNCTIONS ******************************************************************/
+
+/* Check for a FAT32 boot sector at the start of the volume */
+bool FatMount(PFS_VOLUME Volume) {
+    u8 Boot[FS_SECTOR_SIZE];
+    u32 ReservedSectors, FatCount, FatSize, TotalSectors;
+
+    if (!FsCacheRead(Volume->Device, Volume->StartSector * FS_SECTOR_SIZE, Boot, FS_SECTOR_SIZE)) {
+        return FALSE;
+    }
+    if (Boot[510] != 0x55 || Boot[511] != 0xAA || memcmp(&Boot[82], "FAT32", 5) != 0) {
+        return FALSE;
+    }
+    /* bytes per sector, sectors per cluster must be a power of two, FAT16 size must be zero */
+    if (*(u16 *) &Boot[11] != FS_SECTOR_SIZE || Boot[13] == 0 || (Boot[13] & (Boot[13] - 1)) != 0 ||
+        *(u16 *) &Boot[22] != 0) {
+        return FALSE;
+    }
+
+    ReservedSectors = *(u16 *) &Boot[14];
+    FatCount = Boot[16];
+    FatSize = *(u32 *) &Boot[36];
+    TotalSectors = *(u16 *) &Boot[19] ? *(u16 *) &Boot[19] : *(u32 *) &Boot[32];
+    if (FatCount == 0 || FatSize == 0 || ReservedSectors + (FatCount * FatSize) >= TotalSectors) {
+        return FALSE;
+    }
+
+    Volume->Type = FsTypeFat32;
+    Volume->Fat.SectorsPerCluster = Boot[13];
+    Volume->Fat.FatStart = ReservedSectors;
+    Volume->Fat.DataStart = ReservedSectors + (FatCount * FatSize);
+    Volume->Fat.RootCluster = *(u32 *) &Boot[44];
+    Volume->Fat.ClusterCount = (TotalSectors - Volume->Fat.DataStart) / Volume->Fat.SectorsPerCluster;
+    return TRUE;
+}
+
+void FatRoot(PFS_VOLUME Volume, PFS_FILE File) {
+    File->Volume = Volume;
+    File->Size = 0;
+    File->Id = Volume->Fat.RootCluster;
+    File->Directory = TRUE;
+}
+
+/* Walk the cluster chain. Runs of consecutive clusters are merged by the caller. */
+bool FatMapExtents(PFS_FILE File, FS_EXTENT_CALLBACK Callback, void *Context) {
+    PFS_VOLUME Volume = File->Volume;
+    u32 Cluster = File->Id;
+
+    while (Cluster >= 2 && Cluster < FAT_END_OF_CHAIN) {
+        u64 Sector = Volume->StartSector + Volume->Fat.DataStart +
+                     ((u64) (Cluster - 2) * Volume->Fat.SectorsPerCluster);
+        u32 Entry;
+
+        if (Cluster - 2 >= Volume->Fat.ClusterCount) {
+            error("FAT cluster %u out of range!\n", Cluster);
+            return FALSE;
+        }
+        if (!Callback(Sector, Volume->Fat.SectorsPerCluster, Context)) {
+            return TRUE;
+        }
+        if (!FsCacheRead(Volume->Device, ((Volume->StartSector + Volume->Fat.FatStart) * FS_SECTOR_SIZE) +
+                                         (Cluster * 4), &Entry, 4)) {
+            return FALSE;
+        }
+        Cluster = Entry & 0x0FFFFFFF;
+    }
+    return TRUE;
+}
+
+/* Add the characters of one long name entry */
+static
+void FatCollectLongName(PFAT_LOOKUP Lookup, const u8 *Entry) {
+    u32 Sequence = Entry[0] & 0x1F;
+    u32 Position = (Sequence - 1) * 13;
+
+    if (Sequence == 0 || Sequence * 13 > FS_MAX_NAME) {
+        Lookup->LongNameLength = 0;
+        return;
+    }
+    /* entries are stored last part first */
+    if (Entry[0] & FAT_ENTRY_LAST_LFN) {
+        Lookup->LongNameLength = Sequence * 13;
+    }
+    for (int i = 0; i < 13; i++) {
+        u16 Character = *(u16 *) &Entry[FatLongNameOffsets[i]];
+
+        if (Character == 0x0000) {
+            if (Position + i < Lookup->LongNameLength) {
+                Lookup->LongNameLength = Position + i;
+            }
+            break;
+        }
+        Lookup->LongName[Position + i] = (Character < 0x80) ? (char) Character : '?';
+    }
+}
+
+static
+bool FatScanDirectory(u64 Sector, u32 Count, void *Context) {
+    PFAT_LOOKUP Lookup = (PFAT_LOOKUP) Context;
+
+    for (u32 Offset = 0; Offset < Count * FS_SECTOR_SIZE; Offset += FAT_ENTRY_SIZE) {
+        u8 Entry[FAT_ENTRY_SIZE];
+        char ShortName[13];
+        u32 ShortLength = 0;
+
+        if (!FsCacheRead(Lookup->Volume->Device, (Sector * FS_SECTOR_SIZE) + Offset, Entry, FAT_ENTRY_SIZE)) {
+            Lookup->Failed = TRUE;
+            return FALSE;
+        }
+        if (Entry[0] == 0) {
+            /* end of directory */
+            return FALSE;
+        }
+        if (Entry[0] == FAT_ENTRY_FREE) {
+            Lookup->LongNameLength = 0;
+            continue;
+        }
+        if (Entry[11] == FAT_ATTR_LONG_NAME) {
+            FatCollectLongName(Lookup, Entry);
+            continue;
+        }
+        if (Entry[11] & FAT_ATTR_VOLUME) {
+            Lookup->LongNameLength = 0;
+            continue;
+        }
+
+        /* 8.3 name without padding */
+        for (int i = 0; i < 8 && Entry[i] != ' '; i++) {
+            ShortName[ShortLength++] = Entry[i];
+        }
+        if (Entry[8] != ' ') {
+            ShortName[ShortLength++] = '.';
+            for (int i = 8; i < 11 && Entry[i] != ' '; i++) {
+                ShortName[ShortLength++] = Entry[i];
+            }
+        }
+
+        if ((Lookup->LongNameLength &&
+             FsNameEquals(Lookup->LongName, Lookup->LongNameLength, Lookup->Name, Lookup->NameLength)) ||
+            FsNameEquals(ShortName, ShortLength, Lookup->Name, Lookup->NameLength)) {
+            Lookup->Result->Volume = Lookup->Volume;
+            Lookup->Result->Id = (*(u16 *) &Entry[20] << 16) | *(u16 *) &Entry[26];
+            Lookup->Result->Size = *(u32 *) &Entry[28];
+            Lookup->Result->Directory = (Entry[11] & FAT_ATTR_DIRECTORY) != 0;
+            Lookup->Found = TRUE;
+            return FALSE;
+        }
+        Lookup->LongNameLength = 0;
+    }
+    return TRUE;
+}
+
+bool FatLookup(PFS_FILE Directory, const char *Name, u32 NameLength, PFS_FILE File) {
+    FAT_LOOKUP Lookup;
+
+    memset(&Lookup, 0, sizeof(FAT_LOOKUP));
+    Lookup.Volume = Directory->Volume;
+    Lookup.Name = Name;
+    Lookup.NameLength = NameLength;
+    Lookup.Result = File;
+
+    if (!FatMapExtents(Directory, FatScanDirectory, &Lookup) || Lookup.Failed) {
+        return FALSE;
+    }
+    /* ".." pointing at the root is stored as cluster 0 */
+    if (Lookup.Found && File->Directory && File->Id == 0) {
+        File->Id = Directory->Volume->Fat.RootCluster;
+    }
+    return Lookup.Found;
+}
@@ -0,0 +1,485 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Read-only filesystem layer (block cache, partitions, file reads) for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+typedef struct {
+    PBLOCK_DEVICE Device; /* Device the line was read from, NULL if empty */
+    u64 Line; /* Line number, i.e. first sector / FS_CACHE_LINE_SECTORS */
+} FS_CACHE_TAG;
+
+/* State for FsReadFile() and FsReadFileRange(); contiguous extents are merged into one run before being read */
+typedef struct {
+    PBLOCK_DEVICE Device;
+    u8 *Destination; /* Where the next byte of the file goes */
+    u64 Size; /* End of the requested range */
+    u64 Remaining; /* Bytes of the range not read yet */
+    u64 Skip; /* Bytes before the range not mapped yet */
+    u64 Mapped; /* Bytes of the file covered by extents seen so far */
+    u64 RunStart; /* First sector of the pending run, or FS_SPARSE */
+    u32 RunCount; /* Sectors in the pending run */
+    BLOCK_CHUNK_CALLBACK Callback; /* Called with the data in file order, or NULL */
+    void *CallbackContext;
+    bool Failed;
+} FS_READ_CONTEXT, *PFS_READ_CONTEXT;
+
+static BLOCK_DEVICE FsDevices[FS_MAX_DEVICES];
+static u32 FsDeviceCount;
+static FS_VOLUME FsVolumes[FS_MAX_VOLUMES];
+static u32 FsVolumeCount;
+static bool FsInitialized;
+
+static FS_CACHE_TAG FsCacheTags[FS_CACHE_LINES];
+static u8 FsCacheData[FS_CACHE_LINES][FS_CACHE_LINE_SIZE] __aligned(4096);
+static PBLOCK_DEVICE FsLastMissDevice;
+static u64 FsLastMissLine;
+
+/* FUNCTIONS ******************************************************************/
+
+/* Block driver glue */
+static
+bool FsAtaRead(void *Context, u64 Lba, u32 Count, void *Buffer) {
+    return AtaReadSectors((PATA_DRIVE) Context, Lba, Count, Buffer);
+}
+
+static
+bool FsAtaStream(void *Context, u64 Lba, u32 Count, void *Buffer, BLOCK_CHUNK_CALLBACK Callback,
+                 void *CallbackContext) {
+    return AtaStreamSectors((PATA_DRIVE) Context, Lba, Count, Buffer, Callback, CallbackContext);
+}
+
+static
+bool FsUsbRead(void *Context, u64 Lba, u32 Count, void *Buffer) {
+    return UsbStorageReadBlocks((PUSB_STORAGE) Context, (u32) Lba, Count, Buffer);
+}
+
+/* Return a cache line, reading it (and on sequential access the line after it) on a miss */
+static
+u8 *FsCacheGetLine(PBLOCK_DEVICE Device, u64 Line) {
+    u32 Slot = (u32) Line & (FS_CACHE_LINES - 1);
+    u64 Sector = Line * FS_CACHE_LINE_SECTORS;
+    u32 Lines = 1;
+    u32 Count;
+
+    if (FsCacheTags[Slot].Device == Device && FsCacheTags[Slot].Line == Line) {
+        return FsCacheData[Slot];
+    }
+    if (Sector >= Device->SectorCount) {
+        return NULL;
+    }
+
+    if (FsLastMissDevice == Device && FsLastMissLine + 1 == Line && Slot + 1 < FS_CACHE_LINES &&
+        Sector + (2 * FS_CACHE_LINE_SECTORS) <= Device->SectorCount) {
+        Lines = 2;
+    }
+    Count = Lines * FS_CACHE_LINE_SECTORS;
+    if (Sector + Count > Device->SectorCount) {
+        /* short line at the end of the device */
+        Count = (u32) (Device->SectorCount - Sector);
+        memset(FsCacheData[Slot], 0, sizeof(FsCacheData[Slot]));
+    }
+
+    FsCacheTags[Slot].Device = NULL;
+    FsCacheTags[Slot + Lines - 1].Device = NULL;
+    if (!Device->Read(Device->Context, Sector, Count, FsCacheData[Slot])) {
+        return NULL;
+    }
+    for (u32 i = 0; i < Lines; i++) {
+        FsCacheTags[Slot + i].Device = Device;
+        FsCacheTags[Slot + i].Line = Line + i;
+    }
+    FsLastMissDevice = Device;
+    FsLastMissLine = Line + Lines - 1;
+    return FsCacheData[Slot];
+}
+
+/* Read any byte range of a device through the cache; used for metadata */
+bool FsCacheRead(PBLOCK_DEVICE Device, u64 ByteOffset, void *Destination, u32 Length) {
+    u8 *Position = (u8 *) Destination;
+
+    while (Length != 0) {
+        u8 *Line = FsCacheGetLine(Device, ByteOffset >> FS_CACHE_LINE_SHIFT);
+        u32 Offset = (u32) (ByteOffset & (FS_CACHE_LINE_SIZE - 1));
+        u32 Size = FS_CACHE_LINE_SIZE - Offset;
+
+        if (!Line) {
+            return FALSE;
+        }
+        if (Size > Length) {
+            Size = Length;
+        }
+        memcpy(Position, Line + Offset, Size);
+        Position += Size;
+        ByteOffset += Size;
+        Length -= Size;
+    }
+    return TRUE;
+}
+
+/* Case-insensitive name comparison, as FAT needs it */
+bool FsNameEquals(const char *Name, u32 NameLength, const char *Other, u32 OtherLength) {
+    if (NameLength != OtherLength) {
+        return FALSE;
+    }
+    for (u32 i = 0; i < NameLength; i++) {
+        char a = Name[i], b = Other[i];
+
+        if (a >= 'A' && a <= 'Z') {
+            a += 'a' - 'A';
+        }
+        if (b >= 'A' && b <= 'Z') {
+            b += 'a' - 'A';
+        }
+        if (a != b) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static
+void FsAddVolume(PBLOCK_DEVICE Device, u64 StartSector, u64 SectorCount) {
+    PFS_VOLUME Volume = &FsVolumes[FsVolumeCount];
+
+    if (FsVolumeCount == FS_MAX_VOLUMES || StartSector + SectorCount > Device->SectorCount) {
+        return;
+    }
+    memset(Volume, 0, sizeof(FS_VOLUME));
+    Volume->Device = Device;
+    Volume->StartSector = StartSector;
+    Volume->SectorCount = SectorCount;
+
+    if (FatMount(Volume) || Ext4Mount(Volume)) {
+        debug_printf("Volume %u: %s at sector %u\n", FsVolumeCount,
+                     (Volume->Type == FsTypeFat32) ? "FAT32" : "ext4", lo32(StartSector));
+        FsVolumeCount++;
+    }
+}
+
+/* Mount the partitions of a GPT or MBR disk, or the whole disk if it has no partition table */
+static
+void FsScanPartitions(PBLOCK_DEVICE Device) {
+    u8 Sector[FS_SECTOR_SIZE];
+    u32 VolumesBefore = FsVolumeCount;
+    bool Gpt = FALSE;
+
+    if (!FsCacheRead(Device, 0, Sector, FS_SECTOR_SIZE)) {
+        return;
+    }
+
+    if (Sector[510] == 0x55 && Sector[511] == 0xAA) {
+        for (int i = 0; i < 4; i++) {
+            if (Sector[446 + (i * 16) + 4] == 0xEE) {
+                Gpt = TRUE;
+            }
+        }
+
+        if (Gpt) {
+            u64 EntryLba;
+            u32 EntryCount, EntrySize;
+
+            if (!FsCacheRead(Device, FS_SECTOR_SIZE, Sector, FS_SECTOR_SIZE) || memcmp(Sector, "EFI PART", 8)) {
+                return;
+            }
+            EntryLba = *(u64 *) &Sector[72];
+            EntryCount = *(u32 *) &Sector[80];
+            EntrySize = *(u32 *) &Sector[84];
+            if (EntrySize < 48 || EntrySize > FS_SECTOR_SIZE) {
+                return;
+            }
+
+            for (u32 i = 0; i < EntryCount; i++) {
+                u8 Entry[48];
+                static const u8 Unused[16];
+
+                if (!FsCacheRead(Device, (EntryLba * FS_SECTOR_SIZE) + (i * EntrySize), Entry, sizeof(Entry))) {
+                    return;
+                }
+                if (memcmp(Entry, Unused, 16) == 0) {
+                    continue;
+                }
+                FsAddVolume(Device, *(u64 *) &Entry[32], *(u64 *) &Entry[40] - *(u64 *) &Entry[32] + 1);
+            }
+            return;
+        }
+
+        for (int i = 0; i < 4; i++) {
+            u8 *Entry = &Sector[446 + (i * 16)];
+
+            if (Entry[4] != 0 && *(u32 *) &Entry[12] != 0) {
+                FsAddVolume(Device, *(u32 *) &Entry[8], *(u32 *) &Entry[12]);
+            }
+        }
+    }
+
+    /* no usable partitions, try a filesystem on the bare device */
+    if (FsVolumeCount == VolumesBefore) {
+        FsAddVolume(Device, 0, Device->SectorCount);
+    }
+}
+
+/* Register a block device and mount its volumes. Returns the number of volumes found on it. */
+u32 FsAddDevice(PBLOCK_DEVICE Device) {
+    u32 VolumesBefore = FsVolumeCount;
+
+    if (FsDeviceCount == FS_MAX_DEVICES) {
+        return 0;
+    }
+    FsDevices[FsDeviceCount] = *Device;
+    FsScanPartitions(&FsDevices[FsDeviceCount++]);
+    return FsVolumeCount - VolumesBefore;
+}
+
+/* Probe USB mass storage and ATA drives and mount every volume on them. Returns the number of volumes. */
+u32 FsInit() {
+    BLOCK_DEVICE Device;
+    PUSB_STORAGE Storage;
+    PATA_DRIVE Drive;
+
+    FsDeviceCount = 0;
+    FsVolumeCount = 0;
+    FsInitialized = TRUE;
+    FsLastMissDevice = NULL;
+    memset(FsCacheTags, 0, sizeof(FsCacheTags));
+
+    /* USB first, the Apple TV normally boots from a USB stick */
+    UsbStorageInit();
+    for (u32 i = 0; (Storage = UsbStorageGetDevice(i)) && FsDeviceCount < FS_MAX_DEVICES; i++) {
+        if (Storage->BlockSize != FS_SECTOR_SIZE) {
+            warn("USB device with %u byte blocks is not supported.\n", Storage->BlockSize);
+            continue;
+        }
+        Device = (BLOCK_DEVICE) { FsUsbRead, NULL, Storage, Storage->BlockCount };
+        FsAddDevice(&Device);
+    }
+    AtaInit();
+    for (u32 i = 0; (Drive = AtaGetDrive(i)) && FsDeviceCount < FS_MAX_DEVICES; i++) {
+        Device = (BLOCK_DEVICE) { FsAtaRead, FsAtaStream, Drive, Drive->SectorCount };
+        FsAddDevice(&Device);
+    }
+    return FsVolumeCount;
+}
+
+/* Quiesce the disk controllers before Linux takes over their memory */
+void FsShutdown() {
+    if (!FsInitialized) {
+        return;
+    }
+    EhciShutdown();
+    FsInitialized = FALSE;
+}
+
+static
+bool FsRoot(PFS_VOLUME Volume, PFS_FILE File) {
+    switch (Volume->Type) {
+        case FsTypeFat32:
+            FatRoot(Volume, File);
+            return TRUE;
+        case FsTypeExt4:
+            return Ext4Root(Volume, File);
+        default:
+            return FALSE;
+    }
+}
+
+static
+bool FsLookup(PFS_FILE Directory, const char *Name, u32 NameLength, PFS_FILE File) {
+    switch (Directory->Volume->Type) {
+        case FsTypeFat32:
+            return FatLookup(Directory, Name, NameLength, File);
+        case FsTypeExt4:
+            return Ext4Lookup(Directory, Name, NameLength, File);
+        default:
+            return FALSE;
+    }
+}
+
+static
+bool FsMapExtents(PFS_FILE File, FS_EXTENT_CALLBACK Callback, void *Context) {
+    switch (File->Volume->Type) {
+        case FsTypeFat32:
+            return FatMapExtents(File, Callback, Context);
+        case FsTypeExt4:
+            return Ext4MapExtents(File, Callback, Context);
+        default:
+            return FALSE;
+    }
+}
+
+static
+bool FsOpenOnVolume(PFS_VOLUME Volume, const char *Path, PFS_FILE File) {
+    FS_FILE Child;
+
+    if (!FsRoot(Volume, File)) {
+        return FALSE;
+    }
+    while (*Path != '\0') {
+        u32 Length = 0;
+
+        if (*Path == '/') {
+            Path++;
+            continue;
+        }
+        while (Path[Length] != '\0' && Path[Length] != '/') {
+            Length++;
+        }
+        if (!File->Directory || !FsLookup(File, Path, Length, &Child)) {
+            return FALSE;
+        }
+        *File = Child;
+        Path += Length;
+    }
+    return TRUE;
+}
+
+/* Open a file by absolute path, searching volumes in probe order */
+bool FsOpen(const char *Path, PFS_FILE File) {
+    for (u32 i = 0; i < FsVolumeCount; i++) {
+        if (FsOpenOnVolume(&FsVolumes[i], Path, File)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Read the pending run. Whole sectors go straight to the destination; only a final partial sector is bounced. */
+static
+bool FsFlushRun(PFS_READ_CONTEXT Read) {
+    while (Read->RunCount != 0 && Read->Remaining != 0) {
+        u32 Count = (Read->RunCount < FS_MAX_RUN_SECTORS) ? Read->RunCount : FS_MAX_RUN_SECTORS;
+        u32 Bytes = Count * FS_SECTOR_SIZE;
+
+        if (Bytes > Read->Remaining) {
+            Count = (u32) (Read->Remaining >> FS_SECTOR_SHIFT);
+            Bytes = Count * FS_SECTOR_SIZE;
+            if (Count == 0) {
+                Count = 1;
+                Bytes = (u32) Read->Remaining;
+            }
+        }
+
+        if (Read->RunStart == FS_SPARSE) {
+            memset(Read->Destination, 0, Bytes);
+        } else if (Bytes == Count * FS_SECTOR_SIZE) {
+            /* a streaming driver hands over each chunk while it transfers the next one */
+            if (Read->Callback && Read->Device->Stream) {
+                if (!Read->Device->Stream(Read->Device->Context, Read->RunStart, Count, Read->Destination,
+                                          Read->Callback, Read->CallbackContext)) {
+                    return FALSE;
+                }
+                Read->Destination += Bytes;
+                Read->Remaining -= Bytes;
+                Read->RunStart += Count;
+                Read->RunCount -= Count;
+                continue;
+            }
+            if (!Read->Device->Read(Read->Device->Context, Read->RunStart, Count, Read->Destination)) {
+                return FALSE;
+            }
+        } else if (!FsCacheRead(Read->Device, Read->RunStart * FS_SECTOR_SIZE, Read->Destination, Bytes)) {
+            return FALSE;
+        }
+        if (Read->Callback) {
+            Read->Callback(Read->Destination, Bytes, Read->CallbackContext);
+        }
+
+        Read->Destination += Bytes;
+        Read->Remaining -= Bytes;
+        if (Read->RunStart != FS_SPARSE) {
+            Read->RunStart += Count;
+        }
+        Read->RunCount -= Count;
+    }
+    Read->RunCount = 0;
+    return TRUE;
+}
+
+static
+bool FsReadExtent(u64 Sector, u32 Count, void *Context) {
+    PFS_READ_CONTEXT Read = (PFS_READ_CONTEXT) Context;
+    bool Contiguous;
+
+    /* Drop whole sectors before the requested range */
+    if (Read->Skip != 0) {
+        u32 Skipped = ((Read->Skip >> FS_SECTOR_SHIFT) < Count) ? (u32) (Read->Skip >> FS_SECTOR_SHIFT) : Count;
+
+        Read->Skip -= (u64) Skipped * FS_SECTOR_SIZE;
+        Read->Mapped += (u64) Skipped * FS_SECTOR_SIZE;
+        Count -= Skipped;
+        if (Sector != FS_SPARSE) {
+            Sector += Skipped;
+        }
+        if (Count == 0) {
+            return Read->Mapped < Read->Size;
+        }
+    }
+
+    Contiguous = (Sector == FS_SPARSE) ? (Read->RunStart == FS_SPARSE)
+                                       : (Read->RunStart != FS_SPARSE && Read->RunStart + Read->RunCount == Sector);
+
+    if (Read->RunCount != 0 && Contiguous && Read->RunCount + Count > Read->RunCount) {
+        Read->RunCount += Count;
+    } else {
+        if (!FsFlushRun(Read)) {
+            Read->Failed = TRUE;
+            return FALSE;
+        }
+        Read->RunStart = Sector;
+        Read->RunCount = Count;
+    }
+
+    Read->Mapped += (u64) Count * FS_SECTOR_SIZE;
+    return Read->Mapped < Read->Size;
+}
+
+static
+bool FsReadRange(PFS_FILE File, u64 Offset, u64 Length, void *Destination, BLOCK_CHUNK_CALLBACK Callback,
+                 void *Context) {
+    FS_READ_CONTEXT Read;
+
+    memset(&Read, 0, sizeof(FS_READ_CONTEXT));
+    Read.Device = File->Volume->Device;
+    Read.Destination = (u8 *) Destination;
+    Read.Size = Offset + Length;
+    Read.Remaining = Length;
+    Read.Skip = Offset;
+    Read.Callback = Callback;
+    Read.CallbackContext = Context;
+
+    if (!FsMapExtents(File, FsReadExtent, &Read) || Read.Failed || !FsFlushRun(&Read)) {
+        return FALSE;
+    }
+    /* ext4 does not store extents for a hole at the end of a file */
+    if (Read.Remaining != 0) {
+        memset(Read.Destination, 0, (u32) Read.Remaining);
+        if (Callback) {
+            Callback(Read.Destination, (u32) Read.Remaining, Context);
+        }
+    }
+    return TRUE;
+}
+
+/* Read a whole file into Destination, which must have room for File->Size bytes */
+bool FsReadFile(PFS_FILE File, void *Destination) {
+    return FsReadRange(File, 0, File->Size, Destination, NULL, NULL);
+}
+
+/*
+ * Read Length bytes starting at Offset, which must be a multiple of FS_SECTOR_SIZE. If a callback is given, it sees
+ * the data in file order as it arrives; on ATA it runs while the next chunk is transferred.
+ */
+bool FsReadFileRange(PFS_FILE File, u64 Offset, u32 Length, void *Destination, BLOCK_CHUNK_CALLBACK Callback,
+                     void *Context) {
+    if ((Offset & (FS_SECTOR_SIZE - 1)) != 0 || Offset + Length > File->Size) {
+        return FALSE;
+    }
+    return FsReadRange(File, Offset, Length, Destination, Callback, Context);
+}
@@ -0,0 +1,197 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Host benchmarks for the loader's C library, memory map and Mach-O code (make host-bench)
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/*
+ * Numbers are TSC cycles on the build machine, medians of SAMPLES runs, next to the host C library doing the same
+ * work. They show relative cost and regressions, not what the Apple TV's Pentium M will take. Rates are bytes per
+ * cycle for the byte routines and work per microsecond, at the measured TSC rate, for the rest.
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include "harness.h"
+
+/* GLOBALS ********************************************************************/
+
+#define SAMPLES         101
+#define MAX_COPY_SIZE   0x400000
+
+static u8 *Source;
+static u8 *Destination;
+static u32 Length;
+static char Haystack[MACH_CMDLINE];
+static char Formatted[256];
+static struct boot_params *Params;
+static double TscPerMicrosecond;
+static PMACHO_HEADER Image;
+
+/* FUNCTIONS ******************************************************************/
+
+static
+unsigned long long Measure(void (*Function)(), u32 Repeat) {
+    unsigned long long Samples[SAMPLES];
+
+    Function(); /* Warm up caches and fault in pages */
+    for (u32 i = 0; i < SAMPLES; i++) {
+        unsigned long long Start = HostReadTsc();
+        for (u32 r = 0; r < Repeat; r++) {
+            Function();
+        }
+        Samples[i] = (HostReadTsc() - Start) / Repeat;
+    }
+    return HostMedian(Samples, SAMPLES);
+}
+
+static
+void LoaderMemcpyRun() {
+    memcpy(Destination + 1, Source, Length);
+}
+
+static
+void LibcMemcpyRun() {
+    HostLibcMemcpy(Destination + 1, Source, Length);
+}
+
+static
+void LoaderMemsetRun() {
+    memset(Destination + 1, 0x5A, Length);
+}
+
+static
+void LibcMemsetRun() {
+    HostLibcMemset(Destination + 1, 0x5A, Length);
+}
+
+static
+void LoaderStrstrRun() {
+    __asm__ __volatile__ ("" : : "r" (strstr(Haystack, "atvloader.verify")));
+}
+
+static
+void LibcStrstrRun() {
+    __asm__ __volatile__ ("" : : "r" (HostLibcStrstr(Haystack, "atvloader.verify")));
+}
+
+static
+void LoaderSprintfRun() {
+    sprintf(Formatted, "%s: 0x%08X%08X - 0x%08X%08X (%s) %d\n", "E820 Map", 0u, 0x100000u, 0u, 0x8000000u,
+            "usable", -42);
+}
+
+static
+void LibcSprintfRun() {
+    HostLibcSnprintf(Formatted, sizeof(Formatted), "%s: 0x%08X%08X - 0x%08X%08X (%s) %d\n", "E820 Map", 0u,
+                     0x100000u, 0u, 0x8000000u, "usable", -42);
+}
+
+static
+void FillE820Run() {
+    fill_e820map(Params);
+}
+
+static
+void FindSectionRun() {
+    u32 Size;
+
+    /* The last section of the last segment, the worst case */
+    GetSectionDataFromHeader(Image, MACHO_PAYLOAD_SEGMENT, "__cpio", &Size);
+}
+
+/*
+ * Amount is the work done by one call, in the units of Rate: "B/cycle" for the byte routines, "<unit>/us" at the
+ * measured TSC rate for the rest. Libc is 0 for loader functions without a C library counterpart.
+ */
+static
+void Report(const char *Name, u32 Amount, const char *Rate, unsigned long long Loader, unsigned long long Libc) {
+    double Scale = strstr(Rate, "/us") ? TscPerMicrosecond : 1;
+    char LibcCycles[24] = "-";
+    char LibcRate[24] = "-";
+
+    if (Libc) {
+        HostLibcSnprintf(LibcCycles, sizeof(LibcCycles), "%llu", Libc);
+        HostLibcSnprintf(LibcRate, sizeof(LibcRate), "%.2f", Amount * Scale / Libc);
+    }
+    HostPrintf("%-12s %8u  %10llu %10s  %10.2f %10s  %s\n", Name, Amount, Loader, LibcCycles,
+               Amount * Scale / (Loader ? Loader : 1), LibcRate, Rate);
+}
+
+static
+void Compare(const char *Name, u32 Amount, const char *Rate, void (*Loader)(), void (*Libc)(), u32 Repeat) {
+    unsigned long long LoaderCycles = Measure(Loader, Repeat);
+
+    Report(Name, Amount, Rate, LoaderCycles, Libc ? Measure(Libc, Repeat) : 0);
+}
+
+static
+void SetupE820() {
+    efi_memory_desc_t *Descriptor;
+    u8 *Map = HostAllocLow(0x1000);
+    u32 Count = 40;
+
+    /* A map shaped like the Apple TV's: mostly alternating runs of boot services and conventional memory */
+    for (u32 i = 0; i < Count; i++) {
+        Descriptor = (efi_memory_desc_t *) (Map + i * 48);
+        Descriptor->type = (i == 0) ? EFI_CONVENTIONAL_MEMORY : (i % 5 == 0) ? EFI_RUNTIME_SERVICES_DATA :
+                           (i % 2) ? EFI_BOOT_SERVICES_DATA : EFI_CONVENTIONAL_MEMORY;
+        Descriptor->phys_addr = (UINT64) i * 0x200000;
+        Descriptor->num_pages = 0x200;
+    }
+    Params = HostAllocLow(sizeof(struct boot_params));
+    Params->efi_info.efi_memmap = (u32) (uintptr_t) Map;
+    Params->efi_info.efi_memmap_size = Count * 48;
+    Params->efi_info.efi_memdesc_size = 48;
+}
+
+static
+void SetupImage() {
+    u8 *Data = HostAllocLow(0x1000);
+    HOST_IMAGE_SECTION Sections[] = {
+        {"__TEXT", "__text", Data, 0x100},
+        {"__TEXT", "__cstring", Data + 0x100, 0x100},
+        {"__TEXT", "__splash", Data + 0x200, 0x100},
+        {"__DATA", "__data", Data + 0x300, 0x100},
+        {"__DATA", "__common", Data + 0x400, 0x100},
+        {"__DATA", "__bss", Data + 0x500, 0x100},
+        {MACHO_PAYLOAD_SEGMENT, "__vmlinuz", Data + 0x600, 0x100},
+        {MACHO_PAYLOAD_SEGMENT, "__initrd", Data + 0x700, 0x100},
+        {MACHO_PAYLOAD_SEGMENT, "__cpio", Data + 0x800, 0x100},
+    };
+
+    Image = HostBuildImage(Sections, sizeof(Sections) / sizeof(Sections[0]));
+}
+
+int main() {
+    static const u32 Sizes[] = {16, 64, 256, 4096, 65536, MAX_COPY_SIZE};
+
+    Source = HostAllocLow(MAX_COPY_SIZE);
+    Destination = HostAllocLow(MAX_COPY_SIZE + 64);
+    HostLibcMemset(Source, 0xC3, MAX_COPY_SIZE);
+    strcpy(Haystack, "root=/dev/sda1 ro quiet splash console=tty0 console=ttyS0,115200n8 video=efifb "
+                     "atvloader.log=serial,memory atvloader.copy=direct atvloader.verify");
+    SetupE820();
+    SetupImage();
+
+    TscPerMicrosecond = HostTscPerMicrosecond();
+    HostPrintf("TSC: %.0f MHz\n", TscPerMicrosecond);
+    HostPrintf("%-12s %8s  %10s %10s  %10s %10s\n", "", "amount", "loader", "libc", "loader", "libc");
+    HostPrintf("%-12s %8s  %10s %10s  %10s %10s\n", "", "", "cycles", "cycles", "rate", "rate");
+    for (u32 i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); i++) {
+        Length = Sizes[i];
+        Compare("memcpy", Length, "B/cycle", LoaderMemcpyRun, LibcMemcpyRun, Length < 4096 ? 64 : 1);
+    }
+    for (u32 i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); i++) {
+        Length = Sizes[i];
+        Compare("memset", Length, "B/cycle", LoaderMemsetRun, LibcMemsetRun, Length < 4096 ? 64 : 1);
+    }
+    Compare("strstr", strlen(Haystack), "B/cycle", LoaderStrstrRun, LibcStrstrRun, 64);
+    LoaderSprintfRun();
+    Compare("vsprintf", strlen(Formatted), "B/us", LoaderSprintfRun, LibcSprintfRun, 64);
+    FillE820Run();
+    Compare("fill_e820map", Params->e820_entries, "entries/us", FillE820Run, NULL, 64);
+    Compare("GetSection", 1, "lookups/us", FindSectionRun, NULL, 64);
+    return 0;
+}
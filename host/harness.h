@@ -0,0 +1,26 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for helpers shared by the host tests, benchmarks and simulator
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _HOST_HARNESS_H
+#define _HOST_HARNESS_H
+
+#include <linuxloader.h>
+#include "platform.h"
+
+typedef struct {
+    const char *SegmentName;
+    const char *SectionName;
+    void *Data; /* Must be in low memory, the section address is a u32 */
+    u32 Size;
+} HOST_IMAGE_SECTION, *PHOST_IMAGE_SECTION;
+
+/* loader.c */
+extern void WrapperInit(u32 BootArgPtr);
+
+extern PMACHO_HEADER HostBuildImage(const HOST_IMAGE_SECTION *Sections, u32 Count);
+
+#endif //_HOST_HARNESS_H
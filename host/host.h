@@ -0,0 +1,32 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Forced include for building loader sources into 64-bit host programs
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/*
+ * The loader brings its own C library functions. Host builds rename them so they can be linked, and compared,
+ * against the host C library. Sizes stay 32-bit through HOST_BUILD in types.h.
+ */
+
+#ifndef _HOST_H
+#define _HOST_H
+
+#define memcpy          LoaderMemcpy
+#define memset          LoaderMemset
+#define memcmp          LoaderMemcmp
+#define strcpy          LoaderStrcpy
+#define strncpy         LoaderStrncpy
+#define strncmp         LoaderStrncmp
+#define strcat          LoaderStrcat
+#define strstr          LoaderStrstr
+#define strlen          LoaderStrlen
+#define crc32           LoaderCrc32
+#define sleep           LoaderSleep
+#define msleep          LoaderMsleep
+#define printf          LoaderPrintf
+#define sprintf         LoaderSprintf
+#define vsprintf        LoaderVsprintf
+
+#endif //_HOST_H
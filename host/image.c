@@ -0,0 +1,70 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Fake Mach-O images for the host tests, benchmarks and simulator
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include "harness.h"
+
+/* GLOBALS ********************************************************************/
+
+/* Stands in for _mh_execute_header, see include/mach.h */
+PMACHO_HEADER HostMachHeader;
+
+/* FUNCTIONS ******************************************************************/
+
+static
+void CopyName(char *Destination, const char *Name) {
+    memset(Destination, 0, 16);
+    strncpy(Destination, Name, 16);
+}
+
+/* Where LoadLinux() ends up in host builds; host/sim.c boots the loader and replaces this */
+__attribute__((weak))
+void HostStartLinux(struct boot_params *boot_params, u32 entry) {
+    fatal("LoadLinux() reached the kernel entry point 0x%08X\n", entry);
+}
+
+/*
+ * Build the load commands of an executable holding Sections. Consecutive sections with the same segment name share
+ * a segment command, like the linker lays them out; the section data itself stays where the caller put it.
+ */
+PMACHO_HEADER HostBuildImage(const HOST_IMAGE_SECTION *Sections, u32 Count) {
+    u32 Size = sizeof(MACHO_HEADER) + Count * (sizeof(MACHO_SEGMENT_COMMAND) + sizeof(MACHO_SECTION));
+    PMACHO_HEADER Header = HostAllocLow(Size);
+    PMACHO_SEGMENT_COMMAND Segment = NULL;
+    u8 *Command = (u8 *) (Header + 1);
+
+    Header->MagicNumber = MACHO_MAGIC;
+    Header->CpuType = 7; /* CPU_TYPE_X86 */
+    Header->CpuSubtype = 3; /* CPU_SUBTYPE_I386_ALL */
+    Header->FileType = 2; /* MH_EXECUTE */
+
+    for (u32 i = 0; i < Count; i++) {
+        if (Segment == NULL || strncmp(Segment->SegmentName, Sections[i].SegmentName, 16) != 0) {
+            Segment = (PMACHO_SEGMENT_COMMAND) Command;
+            Segment->Command = MACHO_LC_SEGMENT;
+            Segment->CommandSize = sizeof(MACHO_SEGMENT_COMMAND);
+            CopyName(Segment->SegmentName, Sections[i].SegmentName);
+            Segment->VMAddress = (u32) (uintptr_t) Sections[i].Data;
+            Command += sizeof(MACHO_SEGMENT_COMMAND);
+            Header->NumberOfCmds++;
+        }
+
+        PMACHO_SECTION Section = (PMACHO_SECTION) Command;
+        CopyName(Section->SectionName, Sections[i].SectionName);
+        CopyName(Section->SegmentName, Sections[i].SegmentName);
+        Section->Address = (u32) (uintptr_t) Sections[i].Data;
+        Section->Size = Sections[i].Size;
+        Segment->VMSize = Section->Address + Section->Size - Segment->VMAddress;
+        Segment->NumberOfSections++;
+        Segment->CommandSize += sizeof(MACHO_SECTION);
+        Command += sizeof(MACHO_SECTION);
+    }
+
+    Header->SizeOfCmds = (u32) (Command - (u8 *) (Header + 1));
+    return Header;
+}
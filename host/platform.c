@@ -0,0 +1,335 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Host platform layer: port I/O, PCI, memory and C library access for loader code built as a host program
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "platform.h"
+
+/* GLOBALS ********************************************************************/
+
+#define COM1 0x3F8
+
+char *HostSerial;
+size_t HostSerialLength;
+int HostSerialEcho;
+static size_t HostSerialSize;
+
+void *(*HostLibcMemcpy)(void *, const void *, size_t) = memcpy;
+void *(*HostLibcMemset)(void *, int, size_t) = memset;
+int (*HostLibcMemcmp)(const void *, const void *, size_t) = memcmp;
+char *(*HostLibcStrstr)(const char *, const char *) = strstr;
+int (*HostLibcStrcmp)(const char *, const char *) = strcmp;
+
+/* FUNCTIONS ******************************************************************/
+
+void *HostAllocLow(size_t Size) {
+    void *Memory = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+    if (Memory == MAP_FAILED) {
+        perror("mmap");
+        exit(2);
+    }
+    return Memory;
+}
+
+void *HostMapAt(unsigned long Address, size_t Size) {
+    void *Memory = mmap((void *) Address, Size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (Memory == MAP_FAILED || Memory != (void *) Address) {
+        fprintf(stderr, "cannot map 0x%zx bytes at 0x%lx\n", Size, Address);
+        exit(2);
+    }
+    return Memory;
+}
+
+int HostPrintf(const char *Format, ...) {
+    va_list Args;
+    int Length;
+
+    va_start(Args, Format);
+    Length = vprintf(Format, Args);
+    va_end(Args);
+    fflush(stdout);
+    return Length;
+}
+
+int HostLibcSnprintf(char *Buffer, size_t Size, const char *Format, ...) {
+    va_list Args;
+    int Length;
+
+    va_start(Args, Format);
+    Length = vsnprintf(Buffer, Size, Format, Args);
+    va_end(Args);
+    return Length;
+}
+
+void HostExit(int Status) {
+    fflush(stdout);
+    exit(Status);
+}
+
+int HostWriteFile(const char *Path, const void *Data, size_t Length) {
+    FILE *File = fopen(Path, "wb");
+
+    if (!File) {
+        perror(Path);
+        return 0;
+    }
+    if (fwrite(Data, 1, Length, File) != Length) {
+        perror(Path);
+        fclose(File);
+        return 0;
+    }
+    return fclose(File) == 0;
+}
+
+/* Read a whole file into low memory */
+void *HostReadFile(const char *Path, size_t *Length) {
+    FILE *File = fopen(Path, "rb");
+    void *Data;
+
+    if (!File) {
+        perror(Path);
+        return NULL;
+    }
+    fseek(File, 0, SEEK_END);
+    *Length = ftell(File);
+    rewind(File);
+    Data = HostAllocLow(*Length ? *Length : 1);
+    if (fread(Data, 1, *Length, File) != *Length) {
+        perror(Path);
+        fclose(File);
+        return NULL;
+    }
+    fclose(File);
+    return Data;
+}
+
+int HostMakeDirectory(const char *Path) {
+    if (mkdir(Path, 0777) != 0 && errno != EEXIST) {
+        perror(Path);
+        return 0;
+    }
+    return 1;
+}
+
+/* Text output for reports; File is a FILE * */
+void *HostOpenFile(const char *Path) {
+    FILE *File = fopen(Path, "w");
+
+    if (!File) {
+        perror(Path);
+    }
+    return File;
+}
+
+int HostFilePrintf(void *File, const char *Format, ...) {
+    va_list Args;
+    int Length;
+
+    va_start(Args, Format);
+    Length = vfprintf(File, Format, Args);
+    va_end(Args);
+    return Length;
+}
+
+void HostCloseFile(void *File) {
+    fclose(File);
+}
+
+static
+void HostPngChunk(FILE *File, const char *Type, const unsigned char *Data, uint32_t Length) {
+    unsigned char Header[8] = {Length >> 24, Length >> 16, Length >> 8, Length, Type[0], Type[1], Type[2], Type[3]};
+    uint32_t Crc = crc32(crc32(0, Header + 4, 4), Data, Length);
+    unsigned char Trailer[4] = {Crc >> 24, Crc >> 16, Crc >> 8, Crc};
+
+    fwrite(Header, 1, sizeof(Header), File);
+    fwrite(Data, 1, Length, File);
+    fwrite(Trailer, 1, sizeof(Trailer), File);
+}
+
+/* Write a 32-bit xRGB framebuffer as an RGB PNG; Pitch is in bytes */
+int HostWritePng(const char *Path, const unsigned int *Pixels, unsigned int Width, unsigned int Height,
+                 unsigned int Pitch) {
+    size_t RowLength = 1 + (size_t) Width * 3;
+    unsigned char *Raw = malloc(RowLength * Height);
+    uLongf PackedLength = compressBound(RowLength * Height);
+    unsigned char *Packed = malloc(PackedLength);
+    unsigned char Header[13] = {Width >> 24, Width >> 16, Width >> 8, Width, Height >> 24, Height >> 16, Height >> 8,
+                                Height, 8, 2, 0, 0, 0}; /* 8 bits per channel, truecolor */
+    FILE *File;
+
+    for (unsigned int y = 0; y < Height; y++) {
+        const unsigned int *Row = (const unsigned int *) ((const unsigned char *) Pixels + (size_t) y * Pitch);
+        unsigned char *Out = Raw + y * RowLength;
+
+        *Out++ = 0; /* No filter */
+        for (unsigned int x = 0; x < Width; x++) {
+            *Out++ = Row[x] >> 16;
+            *Out++ = Row[x] >> 8;
+            *Out++ = Row[x];
+        }
+    }
+    if (compress2(Packed, &PackedLength, Raw, RowLength * Height, 6) != Z_OK || !(File = fopen(Path, "wb"))) {
+        free(Raw);
+        free(Packed);
+        return 0;
+    }
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, File);
+    HostPngChunk(File, "IHDR", Header, sizeof(Header));
+    HostPngChunk(File, "IDAT", Packed, PackedLength);
+    HostPngChunk(File, "IEND", NULL, 0);
+    free(Raw);
+    free(Packed);
+    return fclose(File) == 0;
+}
+
+static
+int HostCompareSamples(const void *Left, const void *Right) {
+    unsigned long long a = *(const unsigned long long *) Left, b = *(const unsigned long long *) Right;
+
+    return (a > b) - (a < b);
+}
+
+unsigned long long HostMedian(unsigned long long *Samples, int Count) {
+    qsort(Samples, Count, sizeof(*Samples), HostCompareSamples);
+    return Samples[Count / 2];
+}
+
+/* TSC ticks per microsecond, timed against the monotonic clock */
+double HostTscPerMicrosecond(void) {
+    struct timespec Start, Now;
+    unsigned long long StartTsc, Elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &Start);
+    StartTsc = HostReadTsc();
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &Now);
+        Elapsed = (Now.tv_sec - Start.tv_sec) * 1000000000ULL + Now.tv_nsec - Start.tv_nsec;
+    } while (Elapsed < 100000000); /* 100ms */
+    return (double) (HostReadTsc() - StartTsc) * 1000 / Elapsed;
+}
+
+/* Run Function in a child process and return its exit status, for code that is expected to call fail() */
+int HostRunChild(void (*Function)(void *Context), void *Context) {
+    int Status;
+    pid_t Child;
+
+    fflush(stdout);
+    Child = fork();
+    if (Child == 0) {
+        freopen("/dev/null", "w", stderr);
+        Function(Context);
+        _exit(0);
+    }
+    if (Child < 0 || waitpid(Child, &Status, 0) != Child || !WIFEXITED(Status)) {
+        return -1;
+    }
+    return WEXITSTATUS(Status);
+}
+
+unsigned int HostZlibCrc32(unsigned int Crc, const void *Buffer, unsigned int Length) {
+    return (unsigned int) crc32(Crc, Buffer, Length);
+}
+
+static
+void HostSerialPut(char c) {
+    if (HostSerialLength + 1 >= HostSerialSize) {
+        HostSerialSize = HostSerialSize ? HostSerialSize * 2 : 4096;
+        HostSerial = realloc(HostSerial, HostSerialSize);
+    }
+    HostSerial[HostSerialLength++] = c;
+    HostSerial[HostSerialLength] = '\0';
+    if (HostSerialEcho) {
+        fputc(c, stdout);
+    }
+}
+
+/* Port I/O: COM1 is captured, everything else reads as a floating bus */
+void outb(uint16_t port, uint8_t val) {
+    if (port == COM1) {
+        HostSerialPut((char) val);
+    }
+}
+
+uint8_t inb(uint16_t port) {
+    (void) port;
+    return 0xFF;
+}
+
+void outw(uint16_t port, uint16_t val) {
+    (void) port;
+    (void) val;
+}
+
+uint16_t inw(uint16_t port) {
+    (void) port;
+    return 0xFFFF;
+}
+
+void insw(uint16_t port, void *buf, uint32_t count) {
+    (void) port;
+    memset(buf, 0xFF, count * 2);
+}
+
+void outl(uint16_t port, uint32_t val) {
+    (void) port;
+    (void) val;
+}
+
+uint32_t inl(uint16_t port) {
+    (void) port;
+    return 0xFFFFFFFF;
+}
+
+/* There are no PCI devices, so the disk and USB drivers find nothing */
+uint32_t PciConfigRead32(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    (void) bus;
+    (void) device;
+    (void) function;
+    (void) offset;
+    return 0xFFFFFFFF;
+}
+
+void PciConfigWrite32(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t val) {
+    (void) bus;
+    (void) device;
+    (void) function;
+    (void) offset;
+    (void) val;
+}
+
+char PciFindClass(uint8_t class, uint8_t subclass, uint32_t index, uint8_t *device, uint8_t *function) {
+    (void) class;
+    (void) subclass;
+    (void) index;
+    (void) device;
+    (void) function;
+    return 0;
+}
+
+/* Called by fatal() */
+void fail() {
+    fflush(stdout);
+    fprintf(stderr, "loader called fail()\n");
+    exit(1);
+}
@@ -0,0 +1,57 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the host platform layer used by host tests, benchmarks and the simulator
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/*
+ * Host programs are built like loader sources (HOST_BUILD, host.h) so they can use the loader's headers. The host
+ * C library is only reached through platform.c, which is the one file built against the system headers; this header
+ * therefore sticks to plain C types.
+ */
+
+#ifndef _HOST_PLATFORM_H
+#define _HOST_PLATFORM_H
+
+/* Bytes the loader wrote to COM1 */
+extern char *HostSerial;
+extern __SIZE_TYPE__ HostSerialLength;
+extern int HostSerialEcho;
+
+/* Memory the loader can address with a u32 */
+extern void *HostAllocLow(__SIZE_TYPE__ Size);
+extern void *HostMapAt(unsigned long Address, __SIZE_TYPE__ Size);
+
+/* Host C library */
+extern int HostPrintf(const char *Format, ...);
+extern void HostExit(int Status);
+extern int HostWriteFile(const char *Path, const void *Data, __SIZE_TYPE__ Length);
+extern void *HostReadFile(const char *Path, __SIZE_TYPE__ *Length);
+extern int HostMakeDirectory(const char *Path);
+extern void *HostOpenFile(const char *Path);
+extern int HostFilePrintf(void *File, const char *Format, ...);
+extern void HostCloseFile(void *File);
+extern int HostWritePng(const char *Path, const unsigned int *Pixels, unsigned int Width, unsigned int Height,
+                        unsigned int Pitch);
+extern unsigned long long HostMedian(unsigned long long *Samples, int Count);
+extern double HostTscPerMicrosecond(void);
+extern unsigned int HostZlibCrc32(unsigned int Crc, const void *Buffer, unsigned int Length);
+extern int HostRunChild(void (*Function)(void *Context), void *Context);
+
+/* Host C library baselines for the loader's own implementations */
+extern void *(*HostLibcMemcpy)(void *Destination, const void *Source, __SIZE_TYPE__ Count);
+extern void *(*HostLibcMemset)(void *Destination, int Value, __SIZE_TYPE__ Count);
+extern int (*HostLibcMemcmp)(const void *Left, const void *Right, __SIZE_TYPE__ Count);
+extern char *(*HostLibcStrstr)(const char *Haystack, const char *Needle);
+extern int (*HostLibcStrcmp)(const char *Left, const char *Right);
+extern int HostLibcSnprintf(char *Buffer, __SIZE_TYPE__ Size, const char *Format, ...);
+
+static inline unsigned long long HostReadTsc(void) {
+    unsigned int Low, High;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (Low), "=d" (High));
+    return ((unsigned long long) High << 32) | Low;
+}
+
+#endif //_HOST_PLATFORM_H
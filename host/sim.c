@@ -0,0 +1,351 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Runs the whole loader as a host process against a simulated Apple TV (make host-sim)
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/*
+ * The simulator plays boot.efi: it builds MACH_BOOTARGS with an EFI memory map, an EFI system table carrying the
+ * ACPI RSDP and a framebuffer, stands in a Mach-O header whose __PAYLOAD sections hold the kernel and initrd, and
+ * calls WrapperInit(). Low "physical" memory (the GDT at 0x94000 and the kernel at 1MB) is a fixed mapping, so the
+ * host programs are linked above it (see HOST_LDFLAGS). LoadLinux() ends in HostStartLinux() below, which writes:
+ *
+ *   boot_params.bin    the zero page handed to Linux
+ *   boot_params.txt    decoded boot_params, the boot timeline and checks of what the loader left in memory
+ *   initrd.img         the initrd with the loader-generated initramfs appended
+ *   serial.log         everything the loader wrote to COM1
+ *   screen.png         the framebuffer
+ *
+ *   sim [-o <dir>] [-c <cmdline>] [-k <bzImage>] [-i <initrd>] [-s <splash.rle>]
+ *
+ * Without -k a small fake bzImage is generated, so the whole path runs without a real kernel.
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include "harness.h"
+
+/* GLOBALS ********************************************************************/
+
+#define SIM_LOW_MEMORY_BASE     0x80000 /* Covers the GDT at 0x94000 */
+#define SIM_LOW_MEMORY_END      0x4000000 /* Room for the protected mode kernel at 1MB */
+#define SIM_MEMORY_SIZE         0x10000000 /* 256MB, like the Apple TV */
+#define SIM_SCREEN_WIDTH        1280
+#define SIM_SCREEN_HEIGHT       720
+#define SIM_DESCRIPTOR_SIZE     48 /* What Apple's firmware uses */
+#define SIM_CPIO_RESERVE        0x40000
+#define SIM_SETUP_SECTS         4
+
+static const char *OutputDirectory = "sim-out";
+static const char *CommandLine = "console=tty0 console=ttyS0,115200n8 quiet";
+static u8 *Kernel;
+static u32 KernelLength;
+static u8 *Initrd;
+static u32 InitrdLength;
+static u64 StartTsc;
+
+/* FUNCTIONS ******************************************************************/
+
+static
+void *LowZero(u32 Size) {
+    /* Fresh anonymous mappings are zeroed */
+    return HostAllocLow(Size ? Size : 1);
+}
+
+/* A bzImage that passes the loader's checks: boot sector, setup header, setup code and a patterned kernel */
+static
+void FakeKernel() {
+    const u32 SetupLength = (SIM_SETUP_SECTS + 1) * 512;
+    const u32 ProtectedLength = 0x40000;
+
+    KernelLength = SetupLength + ProtectedLength;
+    Kernel = LowZero(KernelLength);
+
+    struct setup_header *Header = (struct setup_header *) (Kernel + 0x1F1);
+    Header->setup_sects = SIM_SETUP_SECTS;
+    Header->boot_flag = 0xAA55;
+    Header->jump = 0x66EB; /* Setup header ends at 0x268, boot protocol 2.15 */
+    Header->header = 0x53726448; /* "HdrS" */
+    Header->version = 0x020F;
+    Header->kernel_version = 0x400 - 0x200;
+    Header->loadflags = 0x01; /* LOADED_HIGH */
+    Header->code32_start = 0x100000;
+    Header->initrd_addr_max = 0x7FFFFFFF;
+    Header->kernel_alignment = 0x200000;
+    Header->cmdline_size = 2047;
+    Header->init_size = ProtectedLength * 4;
+    strcpy((char *) Kernel + 0x400, "6.1.0-sim (host@sim) #1 SMP");
+
+    for (u32 i = SetupLength; i < KernelLength; i++) {
+        Kernel[i] = (u8) (i * 7 + (i >> 10));
+    }
+}
+
+static
+void FakeInitrd() {
+    static const char Message[] = "fake initrd for the loader simulator\n";
+
+    InitrdLength = sizeof(Message) - 1;
+    Initrd = LowZero(InitrdLength);
+    memcpy(Initrd, Message, InitrdLength);
+}
+
+static
+void AddDescriptor(u8 *Map, u32 *Size, u32 Type, UINT64 Start, UINT64 End, UINT64 Attribute) {
+    efi_memory_desc_t *Descriptor = (efi_memory_desc_t *) (Map + *Size);
+
+    Descriptor->type = Type;
+    Descriptor->phys_addr = Start;
+    Descriptor->virt_addr = (Attribute & EFI_MEMORY_RUNTIME) ? Start : 0;
+    Descriptor->num_pages = (End - Start) >> EFI_PAGE_SHIFT;
+    Descriptor->attribute = Attribute;
+    *Size += SIM_DESCRIPTOR_SIZE;
+}
+
+/* Roughly the memory map of an Apple TV with 256MB, as boot.efi leaves it */
+static
+void SetupMemoryMap(PMACH_BOOTARGS Args) {
+    u8 *Map = LowZero(0x1000);
+    u32 Size = 0;
+
+    AddDescriptor(Map, &Size, EFI_CONVENTIONAL_MEMORY, 0x0, 0xA0000, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_RESERVED_TYPE, 0xA0000, 0x100000, EFI_MEMORY_UC);
+    AddDescriptor(Map, &Size, EFI_LOADER_DATA, 0x100000, 0x2000000, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_LOADER_CODE, 0x2000000, 0x4000000, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_CONVENTIONAL_MEMORY, 0x4000000, 0xF000000, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_BOOT_SERVICES_DATA, 0xF000000, 0xF800000, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_RUNTIME_SERVICES_CODE, 0xF800000, 0xF900000,
+                  EFI_MEMORY_WB | EFI_MEMORY_RUNTIME);
+    AddDescriptor(Map, &Size, EFI_RUNTIME_SERVICES_DATA, 0xF900000, 0xFE00000,
+                  EFI_MEMORY_WB | EFI_MEMORY_RUNTIME);
+    AddDescriptor(Map, &Size, EFI_ACPI_RECLAIM_MEMORY, 0xFE00000, 0xFE10000, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_ACPI_MEMORY_NVS, 0xFE10000, 0xFE20000, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_CONVENTIONAL_MEMORY, 0xFE20000, SIM_MEMORY_SIZE, EFI_MEMORY_WB);
+    AddDescriptor(Map, &Size, EFI_MEMORY_MAPPED_IO, 0xF0000000, 0xF4000000, EFI_MEMORY_UC | EFI_MEMORY_RUNTIME);
+    AddDescriptor(Map, &Size, EFI_MEMORY_MAPPED_IO, 0xFEC00000, 0xFEC01000, EFI_MEMORY_UC | EFI_MEMORY_RUNTIME);
+
+    Args->EfiMemoryMap = (u32) (uintptr_t) Map;
+    Args->EfiMemoryMapSize = Size;
+    Args->EfiMemoryDescriptorSize = SIM_DESCRIPTOR_SIZE;
+    Args->EfiMemoryDescriptorVersion = EFI_MEMORY_DESCRIPTOR_VERSION;
+}
+
+static
+u8 Checksum(const u8 *Data, u32 Length) {
+    u8 Sum = 0;
+
+    for (u32 i = 0; i < Length; i++) {
+        Sum += Data[i];
+    }
+    return (u8) -Sum;
+}
+
+/* EFI system table with ACPI 1.0 and 2.0 configuration tables pointing at one RSDP */
+static
+void SetupSystemTable(PMACH_BOOTARGS Args) {
+    efi_system_table_t *SystemTable = LowZero(sizeof(efi_system_table_t));
+    efi_config_table_t *Tables = LowZero(2 * sizeof(efi_config_table_t));
+    acpi_rsdp_t *Rsdp = LowZero(sizeof(acpi_rsdp_t));
+
+    memcpy(Rsdp->signature, "RSD PTR ", 8);
+    memcpy(Rsdp->oem_id, "APPLE ", 6);
+    Rsdp->revision = 2;
+    Rsdp->length = sizeof(acpi_rsdp_t);
+    Rsdp->checksum = Checksum((u8 *) Rsdp, 20);
+    Rsdp->ext_checksum = Checksum((u8 *) Rsdp, sizeof(acpi_rsdp_t));
+
+    Tables[0].guid = ACPI_TABLE_GUID;
+    Tables[0].table = (u32) (uintptr_t) Rsdp;
+    Tables[1].guid = ACPI_20_TABLE_GUID;
+    Tables[1].table = (u32) (uintptr_t) Rsdp;
+
+    SystemTable->hdr.signature = 0x5453595320494249ULL; /* "IBI SYST" */
+    SystemTable->hdr.revision = (1 << 16) | 10;
+    SystemTable->hdr.headersize = sizeof(efi_system_table_t);
+    SystemTable->nr_tables = 2;
+    SystemTable->tables = (u32) (uintptr_t) Tables;
+
+    Args->EfiSystemTable = (u32) (uintptr_t) SystemTable;
+    Args->EfiMode = 32;
+}
+
+/* Lay out the payload like the Makefile does: page aligned kernel and initrd, the cpio reserve right behind */
+static
+void SetupImage(const u8 *Splash, u32 SplashLength) {
+    u32 InitrdOffset = PAGE_ALIGN(KernelLength);
+    u32 CpioOffset = InitrdOffset + InitrdLength;
+    u8 *Payload = LowZero(CpioOffset + SIM_CPIO_RESERVE);
+    u8 *Text = LowZero(0x1000 + SplashLength);
+
+    memcpy(Payload, Kernel, KernelLength);
+    memcpy(Payload + InitrdOffset, Initrd, InitrdLength);
+    memcpy(Text + 0x1000, Splash, SplashLength);
+
+    HOST_IMAGE_SECTION Sections[] = {
+        {"__TEXT", "__text", Text, 0x1000},
+        {"__TEXT", "__splash", Text + 0x1000, SplashLength},
+        {MACHO_PAYLOAD_SEGMENT, "__vmlinuz", Payload, KernelLength},
+        {MACHO_PAYLOAD_SEGMENT, "__initrd", Payload + InitrdOffset, InitrdLength},
+        {MACHO_PAYLOAD_SEGMENT, "__cpio", Payload + CpioOffset, SIM_CPIO_RESERVE},
+    };
+    HostMachHeader = HostBuildImage(Sections, sizeof(Sections) / sizeof(Sections[0]));
+}
+
+static
+PMACH_BOOTARGS SetupBootArgs() {
+    PMACH_BOOTARGS Args = LowZero(sizeof(MACH_BOOTARGS));
+    u32 Pitch = SIM_SCREEN_WIDTH * 4;
+
+    Args->Revision = 4;
+    Args->Version = 1;
+    strncpy(Args->CmdLine, CommandLine, MACH_CMDLINE - 1);
+    Args->Video.BaseAddress = (u32) (uintptr_t) LowZero(Pitch * SIM_SCREEN_HEIGHT);
+    Args->Video.DisplayMode = 1; /* Graphics */
+    Args->Video.Pitch = Pitch;
+    Args->Video.Width = SIM_SCREEN_WIDTH;
+    Args->Video.Height = SIM_SCREEN_HEIGHT;
+    Args->Video.Depth = 32;
+    Args->KernelBaseAddress = 0x2000000;
+    Args->KernelSize = 0x2000000;
+    SetupMemoryMap(Args);
+    SetupSystemTable(Args);
+    return Args;
+}
+
+static
+const char *OutputPath(char *Buffer, const char *Name) {
+    sprintf(Buffer, "%s/%s", OutputDirectory, Name);
+    return Buffer;
+}
+
+static
+void ReportBootParams(void *File, struct boot_params *Params, u32 Entry) {
+    struct setup_header *Header = &Params->hdr;
+    struct screen_info *Screen = &Params->screen_info;
+    const u8 *SetupEnd = Kernel + (Kernel[0x1F1] + 1) * 512;
+    u32 ProtectedLength = KernelLength - (Kernel[0x1F1] + 1) * 512;
+
+    HostFilePrintf(File, "entry               0x%08x\n", Entry);
+    HostFilePrintf(File, "boot protocol       %u.%02u\n", Header->version >> 8, Header->version & 0xFF);
+    HostFilePrintf(File, "type_of_loader      0x%02x\n", Header->type_of_loader);
+    HostFilePrintf(File, "loadflags           0x%02x\n", Header->loadflags);
+    HostFilePrintf(File, "vid_mode            0x%04x\n", Header->vid_mode);
+    HostFilePrintf(File, "cmd_line_ptr        0x%08x \"%s\"\n", Header->cmd_line_ptr,
+                   (const char *) (uintptr_t) Header->cmd_line_ptr);
+    HostFilePrintf(File, "ramdisk             0x%08x size %u\n", Header->ramdisk_image, Header->ramdisk_size);
+    HostFilePrintf(File, "acpi_rsdp_addr      0x%08llx\n", Params->acpi_rsdp_addr);
+    HostFilePrintf(File, "efi_loader_sig      %.4s\n", (const char *) &Params->efi_info.efi_loader_signature);
+    HostFilePrintf(File, "efi_systab          0x%08x\n", Params->efi_info.efi_systab);
+    HostFilePrintf(File, "efi_memmap          0x%08x size %u desc %u version %u\n", Params->efi_info.efi_memmap,
+                   Params->efi_info.efi_memmap_size, Params->efi_info.efi_memdesc_size,
+                   Params->efi_info.efi_memdesc_version);
+    HostFilePrintf(File, "screen              0x%08x %ux%u depth %u line %u size %u type %u\n", Screen->lfb_base,
+                   Screen->lfb_width, Screen->lfb_height, Screen->lfb_depth, Screen->lfb_linelength,
+                   Screen->lfb_size, Screen->orig_video_isVGA);
+
+    HostFilePrintf(File, "e820                %u entries\n", Params->e820_entries);
+    for (u32 i = 0; i < Params->e820_entries; i++) {
+        HostFilePrintf(File, "  0x%016llx-0x%016llx type %u\n", Params->e820_table[i].addr,
+                       Params->e820_table[i].addr + Params->e820_table[i].size, Params->e820_table[i].type);
+    }
+
+    /* What the loader must have left in memory for the kernel */
+    HostFilePrintf(File, "kernel at 0x%08x    %s\n", Entry,
+                   HostLibcMemcmp((void *) (uintptr_t) Entry, SetupEnd, ProtectedLength) == 0 ? "ok" : "MISMATCH");
+    HostFilePrintf(File, "setup header copied %s\n",
+                   Header->header == *(u32 *) (Kernel + 0x202) && Header->setup_sects == Kernel[0x1F1] ?
+                   "ok" : "MISMATCH");
+}
+
+/* Replaces the jump to Linux at the end of LoadLinux() */
+void HostStartLinux(struct boot_params *boot_params, u32 entry) {
+    u64 Cycles = HostReadTsc() - StartTsc;
+    char Path[512];
+    char Timeline[TIMELINE_MAX_MARKS * 80];
+    void *File;
+
+    TimelineFormat(Timeline, sizeof(Timeline));
+
+    HostWriteFile(OutputPath(Path, "boot_params.bin"), boot_params, sizeof(struct boot_params));
+    HostWriteFile(OutputPath(Path, "initrd.img"), (void *) (uintptr_t) boot_params->hdr.ramdisk_image,
+                  boot_params->hdr.ramdisk_size);
+    HostWriteFile(OutputPath(Path, "serial.log"), HostSerial, HostSerialLength);
+    HostWritePng(OutputPath(Path, "screen.png"), (const unsigned int *) (uintptr_t) BootArgs->Video.BaseAddress,
+                 BootArgs->Video.Width, BootArgs->Video.Height, BootArgs->Video.Pitch);
+
+    File = HostOpenFile(OutputPath(Path, "boot_params.txt"));
+    if (File) {
+        ReportBootParams(File, boot_params, entry);
+        HostFilePrintf(File, "\n%s%s", TIMELINE_HEADER, Timeline);
+        HostFilePrintf(File, "WrapperInit() to LoadLinux() end: %llu kcycles\n", Cycles >> 10);
+        HostCloseFile(File);
+    }
+
+    HostPrintf("%s%s", TIMELINE_HEADER, Timeline);
+    HostPrintf("WrapperInit() to LoadLinux() end: %llu kcycles\n", Cycles >> 10);
+    HostPrintf("Linux would start at 0x%08x; results are in %s\n", entry, OutputDirectory);
+    HostExit(0);
+}
+
+static
+void Usage() {
+    HostPrintf("usage: sim [-o <dir>] [-c <cmdline>] [-k <bzImage>] [-i <initrd>] [-s <splash.rle>]\n");
+    HostExit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *KernelPath = NULL, *InitrdPath = NULL, *SplashPath = NULL;
+    __SIZE_TYPE__ Length;
+    u8 *Splash = NULL;
+    u32 SplashLength = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc || argv[i][0] != '-' || argv[i][2] != '\0') {
+            Usage();
+        }
+        switch (argv[i++][1]) {
+            case 'o': OutputDirectory = argv[i]; break;
+            case 'c': CommandLine = argv[i]; break;
+            case 'k': KernelPath = argv[i]; break;
+            case 'i': InitrdPath = argv[i]; break;
+            case 's': SplashPath = argv[i]; break;
+            default: Usage();
+        }
+    }
+
+    if (KernelPath) {
+        if (!(Kernel = HostReadFile(KernelPath, &Length))) {
+            HostExit(2);
+        }
+        KernelLength = Length;
+    } else {
+        FakeKernel();
+    }
+    if (InitrdPath) {
+        if (!(Initrd = HostReadFile(InitrdPath, &Length))) {
+            HostExit(2);
+        }
+        InitrdLength = Length;
+    } else {
+        FakeInitrd();
+    }
+    if (SplashPath) {
+        if (!(Splash = HostReadFile(SplashPath, &Length))) {
+            HostExit(2);
+        }
+        SplashLength = Length;
+    }
+
+    if (!HostMakeDirectory(OutputDirectory)) {
+        HostExit(2);
+    }
+    HostMapAt(SIM_LOW_MEMORY_BASE, SIM_LOW_MEMORY_END - SIM_LOW_MEMORY_BASE);
+    SetupImage(Splash, SplashLength);
+    PMACH_BOOTARGS Args = SetupBootArgs();
+
+    StartTsc = HostReadTsc();
+    WrapperInit((u32) (uintptr_t) Args);
+    /* WrapperInit() only comes back if LoadLinux() did */
+    return 1;
+}
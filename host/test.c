@@ -0,0 +1,893 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Host tests for the loader's C library, memory map, Mach-O, command line, splash and filesystem code (make host-test)
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include "harness.h"
+
+/* GLOBALS ********************************************************************/
+
+#define GUARD           0xA5
+#define BUFFER_SIZE     0x3000
+
+static u32 Checks;
+static u32 Failures;
+
+#define CHECK(Condition, ...)                                       \
+    do {                                                            \
+        Checks++;                                                   \
+        if (!(Condition)) {                                         \
+            Failures++;                                             \
+            HostPrintf("%s:%d: ", __FILE__, __LINE__);              \
+            HostPrintf(__VA_ARGS__);                                \
+            HostPrintf("\n");                                       \
+        }                                                           \
+    } while (0)
+
+/* FUNCTIONS ******************************************************************/
+
+static
+void Pattern(u8 *Buffer, u32 Size, u32 Seed) {
+    for (u32 i = 0; i < Size; i++) {
+        Buffer[i] = (u8) (i * 31 + Seed * 7 + (i >> 8));
+    }
+}
+
+/* Loader messages go to the screen too, give them a small one */
+static
+void SetupBootArgs() {
+    BootArgs = HostAllocLow(sizeof(MACH_BOOTARGS));
+    BootArgs->Video.Pitch = 640 * 4;
+    BootArgs->Video.Width = 640;
+    BootArgs->Video.Height = 480;
+    BootArgs->Video.Depth = 32;
+    BootArgs->Video.BaseAddress = (u32) (uintptr_t) HostAllocLow(BootArgs->Video.Pitch * BootArgs->Video.Height);
+    SetupScreen();
+}
+
+/* Every length up to 300 and a few large ones, at all source and destination alignments, with guard bytes around */
+static
+void TestMemcpy() {
+    static const u32 Large[] = {1021, 4096, 4099, 8191};
+    u8 *Source = HostAllocLow(BUFFER_SIZE);
+    u8 *Actual = HostAllocLow(BUFFER_SIZE);
+    u8 *Expected = HostAllocLow(BUFFER_SIZE);
+
+    Pattern(Source, BUFFER_SIZE, 1);
+    for (u32 n = 0; n < 300 + sizeof(Large) / sizeof(Large[0]); n++) {
+        u32 Length = n < 300 ? n : Large[n - 300];
+        for (u32 SourceOffset = 0; SourceOffset < 8; SourceOffset++) {
+            for (u32 DestinationOffset = 0; DestinationOffset < 8; DestinationOffset++) {
+                HostLibcMemset(Actual, GUARD, BUFFER_SIZE);
+                HostLibcMemset(Expected, GUARD, BUFFER_SIZE);
+                void *Result = memcpy(Actual + 16 + DestinationOffset, Source + SourceOffset, Length);
+                HostLibcMemcpy(Expected + 16 + DestinationOffset, Source + SourceOffset, Length);
+                CHECK(Result == Actual + 16 + DestinationOffset, "memcpy returned the wrong pointer");
+                CHECK(HostLibcMemcmp(Actual, Expected, BUFFER_SIZE) == 0,
+                      "memcpy length %u source +%u destination +%u differs from libc", Length, SourceOffset,
+                      DestinationOffset);
+            }
+        }
+    }
+}
+
+static
+void TestMemset() {
+    u8 *Actual = HostAllocLow(BUFFER_SIZE);
+    u8 *Expected = HostAllocLow(BUFFER_SIZE);
+
+    for (u32 Length = 0; Length < 300; Length++) {
+        for (u32 Offset = 0; Offset < 8; Offset++) {
+            /* 0x1FF checks that only the low byte of the value is used */
+            static const int Values[] = {0x00, 0x5A, 0xFF, 0x1FF};
+            for (u32 v = 0; v < sizeof(Values) / sizeof(Values[0]); v++) {
+                HostLibcMemset(Actual, GUARD, 512);
+                HostLibcMemset(Expected, GUARD, 512);
+                void *Result = memset(Actual + 16 + Offset, Values[v], Length);
+                HostLibcMemset(Expected + 16 + Offset, Values[v], Length);
+                CHECK(Result == Actual + 16 + Offset, "memset returned the wrong pointer");
+                CHECK(HostLibcMemcmp(Actual, Expected, 512) == 0, "memset length %u offset +%u value 0x%x differs",
+                      Length, Offset, Values[v]);
+            }
+        }
+    }
+    memset(Actual + 3, 0x11, 8191);
+    HostLibcMemset(Expected + 3, 0x11, 8191);
+    CHECK(HostLibcMemcmp(Actual, Expected, 8194) == 0, "memset length 8191 differs");
+}
+
+static
+int Sign(int Value) {
+    return (Value > 0) - (Value < 0);
+}
+
+static
+void TestStrings() {
+    static const char *Haystacks[] = {"", "a", "abc", "root=/dev/sda1 ro quiet", "aaaaab", "abababac", "xx-v x-v -v",
+                                      "initrd=/initrd.img", "mississippi"};
+    static const char *Needles[] = {"", "a", "b", "c", "ab", "abac", "aab", "-v", "ro", "quiet", "sippi", "ssip",
+                                    "issipi", "zzz", "root=/dev/sda1 ro quiet!"};
+
+    for (u32 h = 0; h < sizeof(Haystacks) / sizeof(Haystacks[0]); h++) {
+        for (u32 n = 0; n < sizeof(Needles) / sizeof(Needles[0]); n++) {
+            CHECK(strstr(Haystacks[h], Needles[n]) == HostLibcStrstr(Haystacks[h], Needles[n]),
+                  "strstr(\"%s\", \"%s\") differs from libc", Haystacks[h], Needles[n]);
+        }
+    }
+
+    CHECK(strlen("") == 0 && strlen("quiet") == 5, "strlen");
+    CHECK(Sign(memcmp("abc", "abd", 3)) == Sign(HostLibcMemcmp("abc", "abd", 3)), "memcmp sign");
+    CHECK(Sign(memcmp("\x80", "\x01", 1)) == Sign(HostLibcMemcmp("\x80", "\x01", 1)), "memcmp compares unsigned");
+    CHECK(memcmp("abc", "abd", 2) == 0, "memcmp length");
+    CHECK(strncmp("atvloader.x", "atvloader.", 10) == 0, "strncmp prefix");
+    CHECK(strncmp("abc", "abd", 3) < 0, "strncmp order");
+}
+
+/* The loader's vsprintf against the C library for the conversions the loader uses */
+static
+void TestVsprintf() {
+    char Actual[128], Expected[128];
+
+#define CHECK_FORMAT(...)                                                                   \
+    do {                                                                                    \
+        int ActualLength = sprintf(Actual, __VA_ARGS__);                                    \
+        int ExpectedLength = HostLibcSnprintf(Expected, sizeof(Expected), __VA_ARGS__);     \
+        CHECK(ActualLength == ExpectedLength && HostLibcStrcmp(Actual, Expected) == 0,      \
+              "sprintf(%s) gave \"%s\", libc \"%s\"", #__VA_ARGS__, Actual, Expected);      \
+    } while (0)
+
+    CHECK_FORMAT("plain text");
+    CHECK_FORMAT("%d %d %d", 0, 42, -42);
+    CHECK_FORMAT("%d", -2147483647 - 1);
+    CHECK_FORMAT("%u %u", 0u, 4294967295u);
+    CHECK_FORMAT("%x %X", 0xdeadbeefu, 0xdeadbeefu);
+    CHECK_FORMAT("0x%08X%08X", 0x1u, 0xA0000u);
+    CHECK_FORMAT("[%5d] [%-5d] [%05d]", 42, 42, 42);
+    CHECK_FORMAT("[%+d] [% d]", 7, 7);
+    CHECK_FORMAT("%#x %#o %o", 0x1fu, 8u, 8u);
+    CHECK_FORMAT("[%s] [%8s] [%-8s] [%.3s]", "abc", "abc", "abc", "abcdef");
+    CHECK_FORMAT("%c%c%c", 'A', 'T', 'V');
+    CHECK_FORMAT("100%%");
+    CHECK_FORMAT("Found %s,%s @ 0x%08X size %d\n", "__PAYLOAD", "__vmlinuz", 0x2100000u, 4096);
+    CHECK_FORMAT("%hu %hd", 65537, 65535);
+
+#undef CHECK_FORMAT
+}
+
+static
+void TestCrc32() {
+    u8 *Data = HostAllocLow(BUFFER_SIZE);
+
+    Pattern(Data, BUFFER_SIZE, 3);
+    CHECK(crc32(0, "123456789", 9) == 0xCBF43926, "crc32 check value");
+    CHECK(crc32(0, Data, 0) == 0, "crc32 of nothing");
+    for (u32 Length = 0; Length < 64; Length++) {
+        CHECK(crc32(0, Data + 1, Length) == HostZlibCrc32(0, Data + 1, Length), "crc32 length %u", Length);
+    }
+    /* Streaming in chunks gives the same result as one call */
+    u32 Crc = crc32(0, Data, 1000);
+    Crc = crc32(Crc, Data + 1000, BUFFER_SIZE - 1000);
+    CHECK(Crc == HostZlibCrc32(0, Data, BUFFER_SIZE), "crc32 in chunks");
+}
+
+static
+void AddDescriptor(u8 *Map, u32 *Size, u32 DescriptorSize, u32 Type, UINT64 Start, UINT64 End) {
+    efi_memory_desc_t *Descriptor = (efi_memory_desc_t *) (Map + *Size);
+
+    HostLibcMemset(Descriptor, 0xEE, DescriptorSize); /* Padding behind each descriptor must be skipped */
+    Descriptor->type = Type;
+    Descriptor->pad = 0;
+    Descriptor->phys_addr = Start;
+    Descriptor->virt_addr = 0;
+    Descriptor->num_pages = (End - Start) >> EFI_PAGE_SHIFT;
+    Descriptor->attribute = 0;
+    *Size += DescriptorSize;
+}
+
+static
+void CheckEntry(struct boot_params *Params, u32 Index, UINT64 Start, UINT64 End, u32 Type) {
+    struct boot_e820_entry *Entry = &Params->e820_table[Index];
+
+    CHECK(Index < Params->e820_entries && Entry->addr == Start && Entry->addr + Entry->size == End &&
+          Entry->type == Type, "e820 entry %u is 0x%llx-0x%llx type %u, expected 0x%llx-0x%llx type %u", Index,
+          Entry->addr, Entry->addr + Entry->size, Entry->type, Start, End, Type);
+}
+
+static
+struct boot_params *SetupParams(u8 *Map, u32 MapSize, u32 DescriptorSize) {
+    struct boot_params *Params = HostAllocLow(sizeof(struct boot_params));
+
+    Params->efi_info.efi_memmap = (u32) (uintptr_t) Map;
+    Params->efi_info.efi_memmap_size = MapSize;
+    Params->efi_info.efi_memdesc_size = DescriptorSize;
+    return Params;
+}
+
+/* Apple's firmware uses 48 byte descriptors, 8 more than efi_memory_desc_t */
+static
+void TestE820Map() {
+    const u32 DescriptorSize = 48;
+    u8 *Map = HostAllocLow(0x1000);
+    struct boot_params *Params;
+    u32 MapSize = 0;
+
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_CONVENTIONAL_MEMORY, 0x0, 0x80000);
+    /* Ends inside the 640K-1MB hole: only the part below 640K is RAM, and the next descriptor must still be read */
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_BOOT_SERVICES_DATA, 0x80000, 0xC0000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_RESERVED_TYPE, 0xC0000, 0x100000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_LOADER_CODE, 0x100000, 0x2000000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_CONVENTIONAL_MEMORY, 0x2000000, 0x8000000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_ACPI_RECLAIM_MEMORY, 0x8000000, 0x8001000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_ACPI_MEMORY_NVS, 0x8001000, 0x8003000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_RUNTIME_SERVICES_CODE, 0x8003000, 0x8004000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_MEMORY_MAPPED_IO, 0xF0000000, 0xF4000000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_CONVENTIONAL_MEMORY, 0x100000000ULL, 0x140000000ULL);
+
+    Params = SetupParams(Map, MapSize, DescriptorSize);
+    fill_e820map(Params);
+    CHECK(Params->e820_entries == 8, "fill_e820map made %u entries, expected 8", Params->e820_entries);
+    CheckEntry(Params, 0, 0x0, 0xA0000, E820_RAM);
+    CheckEntry(Params, 1, 0xC0000, 0x100000, E820_RESERVED);
+    CheckEntry(Params, 2, 0x100000, 0x8000000, E820_RAM);
+    CheckEntry(Params, 3, 0x8000000, 0x8001000, E820_ACPI);
+    CheckEntry(Params, 4, 0x8001000, 0x8003000, E820_NVS);
+    CheckEntry(Params, 5, 0x8003000, 0x8004000, E820_RESERVED);
+    CheckEntry(Params, 6, 0xF0000000, 0xF4000000, E820_RESERVED);
+    CheckEntry(Params, 7, 0x100000000ULL, 0x140000000ULL, E820_RAM);
+
+    /* One descriptor across the hole becomes RAM on both sides of it */
+    MapSize = 0;
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_CONVENTIONAL_MEMORY, 0x0, 0x200000);
+    AddDescriptor(Map, &MapSize, DescriptorSize, EFI_ACPI_MEMORY_NVS, 0x200000, 0x201000);
+    Params = SetupParams(Map, MapSize, DescriptorSize);
+    fill_e820map(Params);
+    CHECK(Params->e820_entries == 3, "fill_e820map made %u entries, expected 3", Params->e820_entries);
+    CheckEntry(Params, 0, 0x0, 0xA0000, E820_RAM);
+    CheckEntry(Params, 1, 0x100000, 0x200000, E820_RAM);
+    CheckEntry(Params, 2, 0x200000, 0x201000, E820_NVS);
+}
+
+static
+void FindMissingSection(void *Context) {
+    u32 Size;
+
+    GetSectionDataFromHeader(Context, MACHO_PAYLOAD_SEGMENT, "__missing", &Size);
+}
+
+static
+void TestMachO() {
+    u8 *Text = HostAllocLow(0x1000);
+    u8 *Payload = HostAllocLow(0x3000);
+    HOST_IMAGE_SECTION Sections[] = {
+        {"__TEXT", "__text", Text, 0x800},
+        {"__TEXT", "__splash", Text + 0x800, 0x123},
+        {"__DATA", "__data", Text + 0xA00, 0x40},
+        {MACHO_PAYLOAD_SEGMENT, "__vmlinuz", Payload, 0x1800},
+        {MACHO_PAYLOAD_SEGMENT, "__initrd", Payload + 0x2000, 0x10},
+        {MACHO_PAYLOAD_SEGMENT, "__cpio", Payload + 0x2010, 0},
+    };
+    PMACHO_HEADER Header = HostBuildImage(Sections, sizeof(Sections) / sizeof(Sections[0]));
+    u32 Size;
+
+    for (u32 i = 0; i < sizeof(Sections) / sizeof(Sections[0]); i++) {
+        Size = 0xFFFFFFFF;
+        u8 *Data = GetSectionDataFromHeader(Header, Sections[i].SegmentName, Sections[i].SectionName, &Size);
+        CHECK(Data == Sections[i].Data && Size == Sections[i].Size, "%s,%s found at %p size 0x%x",
+              Sections[i].SegmentName, Sections[i].SectionName, Data, Size);
+    }
+
+    /* A missing section is fatal */
+    CHECK(HostRunChild(FindMissingSection, Header) == 1, "missing section did not call fail()");
+}
+
+/* Tokenize Text as the boot loader's command line */
+static
+char *ParseCmdline(const char *Text) {
+    HostLibcMemset(BootArgs->CmdLine, 0, MACH_CMDLINE);
+    strncpy(BootArgs->CmdLine, Text, MACH_CMDLINE - 1);
+    CmdlineParse(BootArgs->CmdLine);
+    return BootArgs->CmdLine;
+}
+
+static
+bool OptionIs(const char *Key, const char *Value) {
+    PCMDLINE_OPTION Option = CmdlineFind(Key);
+
+    if (Option == NULL) {
+        return FALSE;
+    }
+    if (Value == NULL || Option->Value == NULL) {
+        return Value == Option->Value;
+    }
+    return HostLibcStrcmp(Option->Value, Value) == 0;
+}
+
+static
+void TestCmdline() {
+    char *CmdLine;
+
+    /* Loader options are removed, everything else keeps its order and spelling */
+    CmdLine = ParseCmdline("  atvloader.verbose root=/dev/sda1\tatvloader.log=serial,memory ro  "
+                           "atvloader.copy=direct quiet ");
+    CHECK(HostLibcStrcmp(CmdLine, "root=/dev/sda1 ro quiet") == 0, "Linux gets \"%s\"", CmdLine);
+    CHECK(CmdlineLoaderOptionCount() == 3, "%u loader options", CmdlineLoaderOptionCount());
+    CHECK(OptionIs("root", "/dev/sda1") && OptionIs("ro", NULL) && OptionIs("quiet", NULL), "Linux options");
+    CHECK(CmdlineFind(CMDLINE_LOADER_PREFIX "verbose")->Loader && !CmdlineFind("root")->Loader, "Loader flag");
+    CHECK(CmdlineFind("atvloader") == NULL && CmdlineFind("") == NULL, "partial keys");
+
+    /* Quotes group spaces and are dropped from the value, but Linux gets the option as written */
+    CmdLine = ParseCmdline("atvloader.kernel=\"/boot/my kernel\" dyndbg=\"file x.c +p\" a=b=c \"quoted key\"=1");
+    CHECK(HostLibcStrcmp(CmdLine, "dyndbg=\"file x.c +p\" a=b=c \"quoted key\"=1") == 0, "Linux gets \"%s\"",
+          CmdLine);
+    CHECK(OptionIs(CMDLINE_LOADER_PREFIX "kernel", "/boot/my kernel"), "quoted loader value");
+    CHECK(OptionIs("dyndbg", "file x.c +p") && OptionIs("a", "b=c") && OptionIs("quoted key", "1"), "quoted values");
+
+    /* -v must be a whole option, not part of another one */
+    ParseCmdline("root=/dev/disk/by-label/my-vol x-v -verbose");
+    CHECK(CmdlineFind("-v") == NULL, "-v found inside another option");
+    ParseCmdline("root=/dev/disk/by-label/my-vol -v");
+    CHECK(CmdlineFind("-v") != NULL, "-v not found");
+    CHECK(!CmdlineEquals("-v", "-verbose") && !CmdlineEquals("-verbose", "-v") && CmdlineEquals("-v", "-v"),
+          "CmdlineEquals");
+
+    /* The last occurrence wins, for Linux and loader options */
+    ParseCmdline("console=tty0 atvloader.splash=0 console=ttyS0 atvloader.splash=yes");
+    CHECK(OptionIs("console", "ttyS0"), "console=%s", CmdlineFind("console")->Value);
+    CHECK(CmdlineGetBool(CMDLINE_LOADER_PREFIX "splash", FALSE), "last atvloader.splash did not win");
+
+    /* Booleans and numbers */
+    ParseCmdline("atvloader.benchmark atvloader.verify=off atvloader.splash=maybe atvloader.payload_base=0x6000000 "
+                 "atvloader.log=12abc atvloader.kernel=");
+    CHECK(CmdlineGetBool(CMDLINE_LOADER_PREFIX "benchmark", FALSE), "bare key is TRUE");
+    CHECK(!CmdlineGetBool(CMDLINE_LOADER_PREFIX "verify", TRUE), "off is FALSE");
+    CHECK(CmdlineGetBool(CMDLINE_LOADER_PREFIX "splash", TRUE) && !CmdlineGetBool(CMDLINE_LOADER_PREFIX "splash",
+          FALSE), "invalid boolean gives the default");
+    CHECK(!CmdlineGetBool(CMDLINE_LOADER_PREFIX "missing", FALSE), "missing boolean gives the default");
+    CHECK(CmdlineGetNumber(CMDLINE_LOADER_PREFIX "payload_base", 1) == 0x6000000, "hex number");
+    CHECK(CmdlineGetNumber(CMDLINE_LOADER_PREFIX "log", 7) == 7, "invalid number gives the default");
+    CHECK(CmdlineGetNumber(CMDLINE_LOADER_PREFIX "benchmark", 7) == 7, "bare key gives the default number");
+    CHECK(HostLibcStrcmp(CmdlineGetString(CMDLINE_LOADER_PREFIX "kernel", "default"), "default") == 0,
+          "empty string gives the default");
+
+    /* Copy strategies, as SetupCmdline() reads them */
+    static const struct {
+        const char *CmdLine;
+        const char *Copy;
+        bool Direct;
+        bool Staged;
+    } Copies[] = {
+        {"", "staged", FALSE, TRUE},
+        {"atvloader.copy=direct", "direct", TRUE, FALSE},
+        {"atvloader.copy=staged", "staged", FALSE, TRUE},
+        {"atvloader.copy=garbage", "garbage", FALSE, FALSE},
+        {"atvloader.copy=directly", "directly", FALSE, FALSE},
+        {"atvloader.copy=direct atvloader.copy=staged", "staged", FALSE, TRUE},
+    };
+    for (u32 i = 0; i < sizeof(Copies) / sizeof(Copies[0]); i++) {
+        ParseCmdline(Copies[i].CmdLine);
+        const char *Copy = CmdlineGetString(CMDLINE_LOADER_PREFIX "copy", "staged");
+        CHECK(HostLibcStrcmp(Copy, Copies[i].Copy) == 0 && CmdlineEquals(Copy, "direct") == Copies[i].Direct &&
+              CmdlineEquals(Copy, "staged") == Copies[i].Staged, "\"%s\" gives copy=%s", Copies[i].CmdLine, Copy);
+    }
+
+    /* Sink lists match whole items only */
+    CHECK(CmdlineListContains("screen,serial", "serial") && CmdlineListContains("serial", "serial"), "list item");
+    CHECK(!CmdlineListContains("serials,screen", "serial") && !CmdlineListContains("seria", "serial") &&
+          !CmdlineListContains("", "serial"), "partial list item");
+    CHECK(CmdlineListContains(",,memory,", "memory"), "empty list items");
+
+    /* A full 1023 character command line: one long option needs MACH_CMDLINE bytes of storage */
+    char Long[MACH_CMDLINE];
+    HostLibcMemcpy(Long, "atvloader.initrd=", 17);
+    HostLibcMemset(Long + 17, 'i', MACH_CMDLINE - 1 - 17);
+    Long[MACH_CMDLINE - 1] = '\0';
+    CmdLine = ParseCmdline(Long);
+    CHECK(CmdLine[0] == '\0' && CmdlineLoaderOptionCount() == 1, "long loader option left \"%.20s\"", CmdLine);
+    const char *Initrd = CmdlineGetString(CMDLINE_LOADER_PREFIX "initrd", "");
+    CHECK(strlen(Initrd) == MACH_CMDLINE - 1 - 17 && Initrd[0] == 'i' && Initrd[MACH_CMDLINE - 2 - 17] == 'i',
+          "long value is %u characters", strlen(Initrd));
+
+    /* ... and one character options need two bytes each, more of them than fit in the option table */
+    for (u32 i = 0; i < MACH_CMDLINE - 1; i++) {
+        Long[i] = (i & 1) ? ' ' : 'a' + (i / 2) % 26;
+    }
+    HostLibcMemcpy(Long + MACH_CMDLINE - 4, "-v", 3);
+    CmdLine = ParseCmdline(Long);
+    CHECK(HostLibcStrcmp(CmdLine, Long) == 0, "Linux options changed");
+    CHECK(OptionIs("a", NULL) && CmdlineFind("-v") == NULL, "option table overflow");
+
+    /* Input is never read past MACH_CMDLINE */
+    HostLibcMemset(BootArgs->CmdLine, 'x', MACH_CMDLINE);
+    CmdlineParse(BootArgs->CmdLine);
+    CHECK(strlen(BootArgs->CmdLine) == MACH_CMDLINE - 1 && CmdlineFind("x") == NULL, "unterminated command line");
+}
+
+/* Draw a one row logo from Runs in a __splash section with SectionBytes of run data, and return its first pixel */
+static
+u32 *DrawSplash(const u32 *Runs, u32 RunCount, u32 RunBytes, u32 SectionBytes) {
+    u32 *Section = HostAllocLow(0x1000);
+    PSPLASH_HEADER Logo = (PSPLASH_HEADER) Section;
+    HOST_IMAGE_SECTION Sections[] = {
+        {"__TEXT", "__splash", Section, sizeof(SPLASH_HEADER) + SectionBytes},
+    };
+    u32 Width = BootArgs->Video.Pitch / 4;
+
+    Logo->Magic = SPLASH_MAGIC;
+    Logo->Width = 4;
+    Logo->Height = 1;
+    Logo->RunBytes = RunBytes;
+    HostLibcMemcpy(Logo + 1, Runs, RunCount * sizeof(u32));
+    HostMachHeader = HostBuildImage(Sections, 1);
+    SplashInit();
+    return (u32 *) (uintptr_t) BootArgs->Video.BaseAddress +
+           ((BootArgs->Video.Height - (1 + SPLASH_BAR_GAP + SPLASH_BAR_HEIGHT)) / 2) * Width + (Width - 4) / 2;
+}
+
+/* Runs cut off by the end of the __splash section are not drawn */
+static
+void TestSplash() {
+    static const u32 Complete[] = {SPLASH_RUN_LITERAL | 2, 0x111111, 0x222222, 2, 0x333333};
+    static const u32 Literal[] = {1, 0x111111, SPLASH_RUN_LITERAL | 3, 0x222222, 0x333333, 0x444444};
+    static const u32 Fill[] = {SPLASH_RUN_LITERAL | 2, 0x111111, 0x222222, 2, 0x333333};
+    u32 *Pixel;
+
+    Pixel = DrawSplash(Complete, 5, sizeof(Complete), sizeof(Complete));
+    CHECK(Pixel[0] == 0x111111 && Pixel[1] == 0x222222 && Pixel[2] == 0x333333 && Pixel[3] == 0x333333,
+          "logo is %06x %06x %06x %06x", Pixel[0], Pixel[1], Pixel[2], Pixel[3]);
+
+    /* The literal run has three pixels, but the section ends after the second */
+    Pixel = DrawSplash(Literal, 6, sizeof(Literal) - sizeof(u32), sizeof(Literal) - sizeof(u32));
+    CHECK(Pixel[0] == 0x111111 && Pixel[1] == SPLASH_BACKGROUND && Pixel[3] == SPLASH_BACKGROUND,
+          "cut off literal run drawn as %06x %06x %06x", Pixel[1], Pixel[2], Pixel[3]);
+
+    /* The fill run's color is behind the end of the section */
+    Pixel = DrawSplash(Fill, 5, sizeof(Fill) - sizeof(u32), sizeof(Fill) - sizeof(u32));
+    CHECK(Pixel[1] == 0x222222 && Pixel[2] == SPLASH_BACKGROUND && Pixel[3] == SPLASH_BACKGROUND,
+          "cut off fill run drawn as %06x %06x", Pixel[2], Pixel[3]);
+
+    /* RunBytes larger than the section draws nothing */
+    Pixel = DrawSplash(Complete, 5, sizeof(Complete), sizeof(Complete) - sizeof(u32));
+    CHECK(Pixel[0] == SPLASH_BACKGROUND, "logo with bad RunBytes drawn");
+}
+
+/* In-memory disk for the filesystem tests */
+typedef struct {
+    u8 *Data;
+    u32 SectorCount;
+    u32 Reads; /* Calls to the read function */
+    u32 Chunks; /* Chunks handed to stream callbacks */
+} HOST_DISK, *PHOST_DISK;
+
+typedef struct {
+    u32 Crc;
+    u32 Length;
+} HOST_CHUNKS, *PHOST_CHUNKS;
+
+static
+void Put16(u8 *Buffer, u16 Value) {
+    HostLibcMemcpy(Buffer, &Value, sizeof(Value));
+}
+
+static
+void Put32(u8 *Buffer, u32 Value) {
+    HostLibcMemcpy(Buffer, &Value, sizeof(Value));
+}
+
+static
+void Put64(u8 *Buffer, u64 Value) {
+    HostLibcMemcpy(Buffer, &Value, sizeof(Value));
+}
+
+static
+bool DiskRead(void *Context, u64 Lba, u32 Count, void *Buffer) {
+    PHOST_DISK Disk = (PHOST_DISK) Context;
+
+    Disk->Reads++;
+    if (Count == 0 || Lba + Count > Disk->SectorCount) {
+        return FALSE;
+    }
+    HostLibcMemcpy(Buffer, Disk->Data + (Lba * FS_SECTOR_SIZE), Count * FS_SECTOR_SIZE);
+    return TRUE;
+}
+
+/* Hands the data over two sectors at a time, like AtaStreamSectors() with tiny chunks */
+static
+bool DiskStream(void *Context, u64 Lba, u32 Count, void *Buffer, BLOCK_CHUNK_CALLBACK Callback,
+                void *CallbackContext) {
+    PHOST_DISK Disk = (PHOST_DISK) Context;
+
+    if (!DiskRead(Context, Lba, Count, Buffer)) {
+        return FALSE;
+    }
+    for (u32 Done = 0; Done < Count; Done += 2) {
+        u32 Chunk = (Count - Done < 2) ? Count - Done : 2;
+
+        Callback((u8 *) Buffer + (Done * FS_SECTOR_SIZE), Chunk * FS_SECTOR_SIZE, CallbackContext);
+        Disk->Chunks++;
+    }
+    return TRUE;
+}
+
+static
+void CollectChunk(u8 *Data, u32 Length, void *Context) {
+    PHOST_CHUNKS Chunks = (PHOST_CHUNKS) Context;
+
+    Chunks->Crc = crc32(Chunks->Crc, Data, Length);
+    Chunks->Length += Length;
+}
+
+static
+PBLOCK_DEVICE NewDisk(u32 SectorCount, bool Stream) {
+    PHOST_DISK Disk = HostAllocLow(sizeof(HOST_DISK));
+    PBLOCK_DEVICE Device = HostAllocLow(sizeof(BLOCK_DEVICE));
+
+    Disk->Data = HostAllocLow(SectorCount * FS_SECTOR_SIZE);
+    Disk->SectorCount = SectorCount;
+    Device->Read = DiskRead;
+    Device->Stream = Stream ? DiskStream : NULL;
+    Device->Context = Disk;
+    Device->SectorCount = SectorCount;
+    return Device;
+}
+
+static
+u8 *DiskSector(PBLOCK_DEVICE Device, u64 Sector) {
+    return ((PHOST_DISK) Device->Context)->Data + (Sector * FS_SECTOR_SIZE);
+}
+
+static
+void AddMbrPartition(PBLOCK_DEVICE Device, u32 Index, u8 Type, u32 Start, u32 Count) {
+    u8 *Entry = DiskSector(Device, 0) + 446 + (Index * 16);
+
+    Entry[4] = Type;
+    Put32(&Entry[8], Start);
+    Put32(&Entry[12], Count);
+    DiskSector(Device, 0)[510] = 0x55;
+    DiskSector(Device, 0)[511] = 0xAA;
+}
+
+/* FAT32 test volume: 1K clusters, one 8 sector FAT, data from volume sector 40 */
+#define TEST_FAT_SECTORS        2048
+#define TEST_FAT_KERNEL_SIZE    (15 * 1024 - 100)
+#define TEST_FAT_INITRD_SIZE    1500
+#define TEST_FAT_LONG_NAME      "vmlinuz-6.1-appletv"
+
+static
+u8 *FatCluster(PBLOCK_DEVICE Device, u32 Start, u32 Cluster) {
+    return DiskSector(Device, Start + 40 + ((Cluster - 2) * 2));
+}
+
+static
+void FatChain(PBLOCK_DEVICE Device, u32 Start, u32 Cluster, u32 Next) {
+    Put32(DiskSector(Device, Start + 32) + (Cluster * 4), Next);
+}
+
+static
+void FatShortEntry(u8 *Entry, const char *Name, u8 Attributes, u32 Cluster, u32 Size) {
+    HostLibcMemcpy(Entry, Name, 11);
+    Entry[11] = Attributes;
+    Put16(&Entry[20], Cluster >> 16);
+    Put16(&Entry[26], Cluster & 0xFFFF);
+    Put32(&Entry[28], Size);
+}
+
+static
+void FatLongEntry(u8 *Entry, u32 Sequence, bool Last, const char *Name) {
+    static const u8 Offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+    u32 Length = strlen(Name);
+
+    Entry[0] = Sequence | (Last ? 0x40 : 0);
+    Entry[11] = 0x0F;
+    for (u32 i = 0; i < 13; i++) {
+        u32 Position = ((Sequence - 1) * 13) + i;
+
+        Put16(&Entry[Offsets[i]], (Position < Length) ? Name[Position] : (Position == Length) ? 0 : 0xFFFF);
+    }
+}
+
+/* Fill in a file's clusters from Contents, following the chain in the FAT */
+static
+void FatWriteFile(PBLOCK_DEVICE Device, u32 Start, u32 Cluster, const u8 *Contents, u32 Size) {
+    for (u32 Done = 0; Done < Size; Done += 1024) {
+        HostLibcMemcpy(FatCluster(Device, Start, Cluster), Contents + Done, (Size - Done < 1024) ? Size - Done : 1024);
+        Cluster = *(u32 *) (DiskSector(Device, Start + 32) + (Cluster * 4)) & 0x0FFFFFFF;
+    }
+}
+
+/*
+ * Root: volume label, vmlinuz-6.1-appletv (long name, clusters 10-19 and 30-34), an orphaned long name "ghost"
+ * before a deleted entry, INITRD.IMG (clusters 40-41) and BOOT/ (cluster 3) holding CONFIG.TXT (cluster 50).
+ */
+static
+void BuildFat(PBLOCK_DEVICE Device, u32 Start, const u8 *Kernel, const u8 *Initrd) {
+    u8 *Boot = DiskSector(Device, Start);
+    u8 *Root = FatCluster(Device, Start, 2);
+    u8 *BootDirectory = FatCluster(Device, Start, 3);
+
+    HostLibcMemset(Boot, 0, FS_SECTOR_SIZE);
+    Put16(&Boot[11], FS_SECTOR_SIZE);
+    Boot[13] = 2;
+    Put16(&Boot[14], 32);
+    Boot[16] = 1;
+    Put32(&Boot[32], TEST_FAT_SECTORS);
+    Put32(&Boot[36], 8);
+    Put32(&Boot[44], 2);
+    HostLibcMemcpy(&Boot[82], "FAT32   ", 8);
+    Boot[510] = 0x55;
+    Boot[511] = 0xAA;
+
+    FatChain(Device, Start, 0, 0x0FFFFFF8);
+    FatChain(Device, Start, 1, 0x0FFFFFFF);
+    FatChain(Device, Start, 2, 0x0FFFFFFF);
+    FatChain(Device, Start, 3, 0x0FFFFFFF);
+    for (u32 Cluster = 10; Cluster < 34; Cluster++) {
+        FatChain(Device, Start, Cluster, (Cluster == 19) ? 30 : Cluster + 1);
+    }
+    FatChain(Device, Start, 34, 0x0FFFFFFF);
+    FatChain(Device, Start, 40, 41);
+    FatChain(Device, Start, 41, 0x0FFFFFFF);
+    FatChain(Device, Start, 50, 0x0FFFFFFF);
+
+    FatShortEntry(Root, "APPLETV    ", 0x08, 0, 0);
+    FatLongEntry(Root + 32, 2, TRUE, TEST_FAT_LONG_NAME);
+    FatLongEntry(Root + 64, 1, FALSE, TEST_FAT_LONG_NAME);
+    FatShortEntry(Root + 96, "VMLINU~1   ", 0x20, 10, TEST_FAT_KERNEL_SIZE);
+    FatLongEntry(Root + 128, 1, TRUE, "ghost");
+    FatShortEntry(Root + 160, "\xE5HOST      ", 0x20, 45, 10);
+    FatShortEntry(Root + 192, "INITRD  IMG", 0x20, 40, TEST_FAT_INITRD_SIZE);
+    FatShortEntry(Root + 224, "BOOT       ", 0x10, 3, 0);
+    FatShortEntry(BootDirectory, ".          ", 0x10, 3, 0);
+    FatShortEntry(BootDirectory + 32, "..         ", 0x10, 0, 0);
+    FatShortEntry(BootDirectory + 64, "CONFIG  TXT", 0x20, 50, 10);
+
+    FatWriteFile(Device, Start, 10, Kernel, TEST_FAT_KERNEL_SIZE);
+    FatWriteFile(Device, Start, 40, Initrd, TEST_FAT_INITRD_SIZE);
+    HostLibcMemcpy(FatCluster(Device, Start, 50), "quiet ro\n\n", 10);
+}
+
+/* ext4 test volume: 1K blocks, one group of 32 256 byte inodes with the inode table at block 5 */
+#define TEST_EXT4_BLOCKS        2048
+#define TEST_EXT4_KERNEL_SIZE   (5 * 1024 + 300)
+#define TEST_EXT4_SPARSE_SIZE   (5 * 1024)
+#define TEST_EXT4_DEEP_SIZE     (3 * 1024 - 1)
+
+static
+u8 *Ext4Block(PBLOCK_DEVICE Device, u32 Start, u32 Block) {
+    return DiskSector(Device, Start + (Block * 2));
+}
+
+static
+u8 *Ext4Inode(PBLOCK_DEVICE Device, u32 Start, u32 Inode, u16 Mode, u32 Size, u16 Entries, u16 Depth) {
+    u8 *Buffer = Ext4Block(Device, Start, 5) + ((Inode - 1) * 256);
+
+    Put16(&Buffer[0x00], Mode);
+    Put32(&Buffer[0x04], Size);
+    Put32(&Buffer[0x20], 0x80000);
+    Put16(&Buffer[0x28], 0xF30A);
+    Put16(&Buffer[0x2A], Entries);
+    Put16(&Buffer[0x2C], 4);
+    Put16(&Buffer[0x2E], Depth);
+    return &Buffer[0x28 + 12];
+}
+
+static
+void Ext4Extent(u8 *Entry, u32 Block, u16 Length, u32 Start) {
+    Put32(&Entry[0], Block);
+    Put16(&Entry[4], Length);
+    Put16(&Entry[6], 0);
+    Put32(&Entry[8], Start);
+}
+
+static
+u32 Ext4DirectoryEntry(u8 *Entry, u32 Inode, const char *Name, u16 RecordLength) {
+    Put32(&Entry[0], Inode);
+    Put16(&Entry[4], RecordLength);
+    Entry[6] = strlen(Name);
+    HostLibcMemcpy(&Entry[8], Name, strlen(Name));
+    return RecordLength;
+}
+
+/*
+ * Root (block 20): vmlinuz (inode 12, blocks 30-31 and 40-43), sparse (inode 13, a hole, block 50, an uninitialized
+ * extent and no extent for its last block) and deep (inode 14, a depth 1 tree with its leaf in block 60).
+ */
+static
+void BuildExt4(PBLOCK_DEVICE Device, u32 Start, const u8 *Kernel, const u8 *Data) {
+    u8 *Super = Ext4Block(Device, Start, 1);
+    u8 *Root = Ext4Block(Device, Start, 20);
+    u8 *Extents, *Leaf;
+    u32 Offset = 0;
+
+    Put32(&Super[0x14], 1);
+    Put32(&Super[0x18], 0);
+    Put32(&Super[0x28], 32);
+    Put16(&Super[0x38], 0xEF53);
+    Put32(&Super[0x4C], 1);
+    Put16(&Super[0x58], 256);
+    Put32(Ext4Block(Device, Start, 2) + 0x08, 5);
+
+    Extents = Ext4Inode(Device, Start, 2, 0x41ED, 1024, 1, 0);
+    Ext4Extent(Extents, 0, 1, 20);
+    Offset += Ext4DirectoryEntry(Root + Offset, 2, ".", 12);
+    Offset += Ext4DirectoryEntry(Root + Offset, 2, "..", 12);
+    Offset += Ext4DirectoryEntry(Root + Offset, 0, "deleted", 16);
+    Offset += Ext4DirectoryEntry(Root + Offset, 12, "vmlinuz", 16);
+    Offset += Ext4DirectoryEntry(Root + Offset, 13, "sparse", 16);
+    Ext4DirectoryEntry(Root + Offset, 14, "deep", 1024 - Offset);
+
+    Extents = Ext4Inode(Device, Start, 12, 0x81A4, TEST_EXT4_KERNEL_SIZE, 2, 0);
+    Ext4Extent(Extents, 0, 2, 30);
+    Ext4Extent(Extents + 12, 2, 4, 40);
+    HostLibcMemcpy(Ext4Block(Device, Start, 30), Kernel, 2048);
+    HostLibcMemcpy(Ext4Block(Device, Start, 40), Kernel + 2048, TEST_EXT4_KERNEL_SIZE - 2048);
+
+    Extents = Ext4Inode(Device, Start, 13, 0x81A4, TEST_EXT4_SPARSE_SIZE, 2, 0);
+    Ext4Extent(Extents, 2, 1, 50);
+    Ext4Extent(Extents + 12, 3, 32768 + 1, 51);
+    HostLibcMemcpy(Ext4Block(Device, Start, 50), Data, 1024);
+    HostLibcMemset(Ext4Block(Device, Start, 51), 0xEE, 1024);
+
+    Extents = Ext4Inode(Device, Start, 14, 0x81A4, TEST_EXT4_DEEP_SIZE, 1, 1);
+    Put32(&Extents[0], 0);
+    Put32(&Extents[4], 60);
+    Leaf = Ext4Block(Device, Start, 60);
+    Put16(&Leaf[0], 0xF30A);
+    Put16(&Leaf[2], 2);
+    Put16(&Leaf[4], 84);
+    Ext4Extent(Leaf + 12, 0, 1, 61);
+    Ext4Extent(Leaf + 24, 1, 2, 63);
+    HostLibcMemcpy(Ext4Block(Device, Start, 61), Data + 1024, 1024);
+    HostLibcMemcpy(Ext4Block(Device, Start, 63), Data + 2048, TEST_EXT4_DEEP_SIZE - 1024);
+}
+
+/* Read a whole file into a buffer with guard bytes behind it */
+static
+u8 *ReadTestFile(const char *Path, u32 ExpectedSize) {
+    FS_FILE File;
+    u8 *Buffer = HostAllocLow(ExpectedSize + 0x1000);
+
+    if (!FsOpen(Path, &File) || File.Directory || File.Size != ExpectedSize) {
+        CHECK(FALSE, "%s not found with size %u", Path, ExpectedSize);
+        return NULL;
+    }
+    HostLibcMemset(Buffer, GUARD, ExpectedSize + 0x1000);
+    CHECK(FsReadFile(&File, Buffer), "%s could not be read", Path);
+    CHECK(Buffer[ExpectedSize] == GUARD, "%s overran its buffer", Path);
+    return Buffer;
+}
+
+static
+void TestFs() {
+    u8 *Kernel = HostAllocLow(TEST_FAT_KERNEL_SIZE);
+    u8 *Data = HostAllocLow(0x1000);
+    u8 *Zero = HostAllocLow(0x1000);
+    PBLOCK_DEVICE Mbr = NewDisk(2400, FALSE);
+    PBLOCK_DEVICE Gpt = NewDisk(34 + (TEST_EXT4_BLOCKS * 2) + 34, TRUE);
+    PBLOCK_DEVICE Bare = NewDisk(TEST_FAT_SECTORS, FALSE);
+    FS_FILE File;
+    u8 *Buffer;
+
+    Pattern(Kernel, TEST_FAT_KERNEL_SIZE, 5);
+    Pattern(Data, 0x1000, 6);
+
+    /* MBR: FAT32 at an odd sector, so files straddle cache lines, and a partition without a filesystem */
+    AddMbrPartition(Mbr, 0, 0x0C, 63, TEST_FAT_SECTORS);
+    AddMbrPartition(Mbr, 1, 0x83, 2200, 100);
+    BuildFat(Mbr, 63, Kernel, Data);
+
+    /* GPT: an unused entry, then ext4 */
+    AddMbrPartition(Gpt, 0, 0xEE, 1, Gpt->SectorCount - 1);
+    HostLibcMemcpy(DiskSector(Gpt, 1), "EFI PART", 8);
+    Put64(DiskSector(Gpt, 1) + 72, 2);
+    Put32(DiskSector(Gpt, 1) + 80, 4);
+    Put32(DiskSector(Gpt, 1) + 84, 128);
+    HostLibcMemset(DiskSector(Gpt, 2) + 128, 0xAF, 16);
+    Put64(DiskSector(Gpt, 2) + 128 + 32, 34);
+    Put64(DiskSector(Gpt, 2) + 128 + 40, 34 + (TEST_EXT4_BLOCKS * 2) - 1);
+    BuildExt4(Gpt, 34, Kernel, Data);
+
+    FsInit();
+    CHECK(FsAddDevice(Mbr) == 1, "MBR disk volumes");
+    CHECK(FsAddDevice(Gpt) == 1, "GPT disk volumes");
+
+    /* FAT32: long and short names, case, subdirectories and ".." */
+    Buffer = ReadTestFile("/" TEST_FAT_LONG_NAME, TEST_FAT_KERNEL_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Kernel, TEST_FAT_KERNEL_SIZE) == 0, "FAT long name file differs");
+    Buffer = ReadTestFile("/VMLINUZ-6.1-APPLETV", TEST_FAT_KERNEL_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Kernel, TEST_FAT_KERNEL_SIZE) == 0, "FAT names are not case-insensitive");
+    Buffer = ReadTestFile("/vmlinu~1", TEST_FAT_KERNEL_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Kernel, TEST_FAT_KERNEL_SIZE) == 0, "FAT short name file differs");
+    Buffer = ReadTestFile("/boot/../initrd.img", TEST_FAT_INITRD_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Data, TEST_FAT_INITRD_SIZE) == 0, "FAT initrd differs");
+    Buffer = ReadTestFile("//BOOT/config.txt", 10);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, "quiet ro\n\n", 10) == 0, "FAT subdirectory file differs");
+    CHECK(!FsOpen("/ghost", &File), "long name before a deleted entry was used");
+    CHECK(FsOpen("/boot", &File) && File.Directory, "FAT directory");
+    CHECK(!FsOpen("/initrd.img/x", &File) && !FsOpen("/vmlinuz-6.1", &File), "FAT partial names");
+
+    /* ext4: extents, holes, uninitialized extents and an index node */
+    Buffer = ReadTestFile("/vmlinuz", TEST_EXT4_KERNEL_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Kernel, TEST_EXT4_KERNEL_SIZE) == 0, "ext4 file differs");
+    Buffer = ReadTestFile("/sparse", TEST_EXT4_SPARSE_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Zero, 2048) == 0 && HostLibcMemcmp(Buffer + 2048, Data, 1024) == 0 &&
+          HostLibcMemcmp(Buffer + 3072, Zero, 2048) == 0, "ext4 sparse file differs");
+    Buffer = ReadTestFile("/deep", TEST_EXT4_DEEP_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Data + 1024, TEST_EXT4_DEEP_SIZE) == 0, "ext4 extent index differs");
+    CHECK(!FsOpen("/deleted", &File) && !FsOpen("/VMLINUZ", &File), "ext4 deleted entry or case-insensitive match");
+    CHECK(FsOpen("/", &File) && File.Directory, "ext4 root");
+
+    /* Ranges stream through the callback in file order, ending with the partial last sector */
+    HOST_CHUNKS Chunks = {0, 0};
+    u32 Length = TEST_EXT4_KERNEL_SIZE - 1024;
+    CHECK(FsOpen("/vmlinuz", &File), "ext4 kernel");
+    HostLibcMemset(Buffer = HostAllocLow(0x2000), GUARD, 0x2000);
+    ((PHOST_DISK) Gpt->Context)->Chunks = 0;
+    CHECK(FsReadFileRange(&File, 1024, Length, Buffer, CollectChunk, &Chunks), "ext4 range");
+    CHECK(HostLibcMemcmp(Buffer, Kernel + 1024, Length) == 0 && Buffer[Length] == GUARD, "ext4 range differs");
+    CHECK(Chunks.Length == Length && Chunks.Crc == HostZlibCrc32(0, Kernel + 1024, Length),
+          "callback saw %u bytes", Chunks.Length);
+    CHECK(((PHOST_DISK) Gpt->Context)->Chunks >= 4, "range was not streamed");
+    CHECK(!FsReadFileRange(&File, 100, 512, Buffer, NULL, NULL), "unaligned range");
+    CHECK(!FsReadFileRange(&File, 0, TEST_EXT4_KERNEL_SIZE + 1, Buffer, NULL, NULL), "range past the end");
+
+    Chunks = (HOST_CHUNKS) {0, 0};
+    CHECK(FsOpen("/" TEST_FAT_LONG_NAME, &File), "FAT kernel");
+    CHECK(FsReadFileRange(&File, 9 * 1024, 5 * 1024, Buffer, CollectChunk, &Chunks) &&
+          HostLibcMemcmp(Buffer, Kernel + (9 * 1024), 5 * 1024) == 0, "FAT range across fragments differs");
+    CHECK(Chunks.Length == 5 * 1024, "callback saw %u bytes", Chunks.Length);
+
+    /* A filesystem on a device without a partition table */
+    BuildFat(Bare, 0, Kernel, Data);
+    FsInit();
+    CHECK(FsAddDevice(Bare) == 1, "bare device volumes");
+    Buffer = ReadTestFile("/" TEST_FAT_LONG_NAME, TEST_FAT_KERNEL_SIZE);
+    CHECK(Buffer && HostLibcMemcmp(Buffer, Kernel, TEST_FAT_KERNEL_SIZE) == 0, "bare FAT file differs");
+    CHECK(!FsOpen("/vmlinuz", &File), "volumes survived FsInit()");
+}
+
+/* printf() and LogPrintf() only reach the sinks atvloader.log enables */
+static
+void TestLog() {
+    u32 Sinks = LogSinks;
+    u32 Start = LoaderLogLength;
+    u32 Serial = HostSerialLength;
+
+    LogSinks = LOG_SINK_MEMORY;
+    LogPrintf("log %d %s\n", 42, "only");
+    CHECK(LoaderLogLength == Start + 12 && HostLibcMemcmp(LoaderLog + Start, "log 42 only\n", 12) == 0,
+          "LogPrintf did not reach the memory log");
+    printf("printf %x\n", 0xABCu);
+    CHECK(LoaderLogLength == Start + 23 && HostSerialLength == Serial, "printf reached a disabled sink");
+
+    LogSinks = LOG_SINK_SERIAL;
+    LogPrintf("dropped\n");
+    printf("serial\n");
+    CHECK(LoaderLogLength == Start + 23 && HostSerialLength == Serial + 7 &&
+          HostLibcMemcmp(HostSerial + Serial, "serial\n", 7) == 0, "printf with only the serial sink");
+
+    LogSinks = Sinks;
+    LoaderLogLength = Start;
+}
+
+int main() {
+    SetupBootArgs();
+
+    TestMemcpy();
+    TestMemset();
+    TestStrings();
+    TestVsprintf();
+    TestCrc32();
+    TestE820Map();
+    TestMachO();
+    TestCmdline();
+    TestSplash();
+    TestFs();
+    TestLog();
+
+    HostPrintf("%u checks, %u failed\n", Checks, Failures);
+    return Failures != 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the ATA/IDE disk driver for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _ATA_H
+#define _ATA_H
+
+#define ATA_SECTOR_SIZE         512
+#define ATA_MAX_DRIVES          4
+
+/* Task file registers, relative to the command block base */
+#define ATA_REG_DATA            0
+#define ATA_REG_ERROR           1
+#define ATA_REG_FEATURES        1
+#define ATA_REG_SECCOUNT        2
+#define ATA_REG_LBA0            3
+#define ATA_REG_LBA1            4
+#define ATA_REG_LBA2            5
+#define ATA_REG_DEVICE          6
+#define ATA_REG_STATUS          7
+#define ATA_REG_COMMAND         7
+
+/* Control block register */
+#define ATA_CTRL_NIEN           (1 << 1) /* Disable interrupts */
+
+#define ATA_STATUS_ERR          (1 << 0)
+#define ATA_STATUS_DRQ          (1 << 3)
+#define ATA_STATUS_DF           (1 << 5)
+#define ATA_STATUS_DRDY         (1 << 6)
+#define ATA_STATUS_BSY          (1 << 7)
+
+#define ATA_CMD_READ_SECTORS        0x20
+#define ATA_CMD_READ_SECTORS_EXT    0x24
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_READ_DMA            0xC8
+#define ATA_CMD_IDENTIFY            0xEC
+
+/* Bus master IDE registers, relative to BAR4 (plus 8 for the secondary channel) */
+#define ATA_BM_COMMAND          0
+#define ATA_BM_STATUS           2
+#define ATA_BM_PRDT             4
+
+#define ATA_BM_CMD_START        (1 << 0)
+#define ATA_BM_CMD_READ         (1 << 3) /* Device to memory */
+#define ATA_BM_STATUS_ACTIVE    (1 << 0)
+#define ATA_BM_STATUS_ERROR     (1 << 1)
+#define ATA_BM_STATUS_IRQ       (1 << 2)
+
+/* Physical region descriptor; a region must not cross a 64K boundary */
+typedef struct {
+    u32 Address; /* Physical address of the region */
+    u16 ByteCount; /* Size of the region, 0 means 64K */
+    u16 Flags; /* End of table flag */
+} __attribute__((packed)) ATA_PRD, *PATA_PRD;
+
+#define ATA_PRD_EOT             0x8000
+#define ATA_PRD_COUNT           32
+
+/* Sectors per DMA command; chunks are pipelined against the caller's processing */
+#define ATA_DMA_CHUNK_SECTORS   256
+
+typedef struct {
+    bool Present; /* Drive answered IDENTIFY */
+    bool Lba48; /* Drive supports 48-bit addressing */
+    bool Dma; /* Controller supports bus mastering */
+    u8 Slave; /* 0 = master, 1 = slave */
+    u16 IoBase; /* Command block base */
+    u16 ControlBase; /* Control block base */
+    u16 BusMasterBase; /* Bus master IDE base for this channel */
+    u64 SectorCount; /* Number of addressable sectors */
+    char Model[41]; /* Model string from IDENTIFY */
+} ATA_DRIVE, *PATA_DRIVE;
+
+/* Called with each completed chunk while the next chunk is being transferred */
+typedef void (*ATA_CHUNK_CALLBACK)(u8 *Buffer, u32 Length, void *Context);
+
+extern u32 AtaInit();
+extern PATA_DRIVE AtaGetDrive(u32 Index);
+extern bool AtaReadSectors(PATA_DRIVE Drive, u64 Lba, u32 Count, void *Buffer);
+extern bool AtaStreamSectors(PATA_DRIVE Drive, u64 Lba, u32 Count, void *Buffer,
+                             ATA_CHUNK_CALLBACK Callback, void *Context);
+
+#endif //_ATA_H
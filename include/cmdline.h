@@ -0,0 +1,44 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the command line tokenizer for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _CMDLINE_H
+#define _CMDLINE_H
+
+#define CMDLINE_MAX_OPTIONS     64
+
+/*
+ * Options starting with this prefix are for the loader and are removed from the command line passed to Linux:
+ *   atvloader.verbose=<bool>       same as -v
+ *   atvloader.splash=<bool>        draw the boot logo on non-verbose boots (default on)
+ *   atvloader.log=<sinks>          comma separated printf() sinks: screen, serial, memory (default all)
+ *   atvloader.copy=<strategy>      staged: read the whole kernel from disk, then copy it to 1MB (default)
+ *                                  direct: read the protected mode kernel from disk straight to 1MB
+ *   atvloader.benchmark=<bool>     report the boot timeline and halt instead of starting Linux
+ *   atvloader.verify=<bool>        CRC-32 disk payloads while reading and check them against <path>.crc32
+ *   atvloader.payload_base=<addr>  lowest address for a kernel and initrd read from disk (default 0x04000000),
+ *                                  ignored if below the end of the kernel's decompression area
+ *   atvloader.kernel=<path>        kernel to read from disk (default FS_KERNEL_PATH)
+ *   atvloader.initrd=<path>        initrd to read from disk (default FS_INITRD_PATH)
+ */
+#define CMDLINE_LOADER_PREFIX   "atvloader."
+
+typedef struct {
+    const char *Key; /* Everything before the first '=' */
+    const char *Value; /* Everything after it with quotes removed, NULL if there is no '=' */
+    bool Loader; /* Key starts with CMDLINE_LOADER_PREFIX */
+} CMDLINE_OPTION, *PCMDLINE_OPTION;
+
+extern void CmdlineParse(char *CmdLine);
+extern PCMDLINE_OPTION CmdlineFind(const char *Key);
+extern u32 CmdlineLoaderOptionCount();
+extern const char *CmdlineGetString(const char *Key, const char *Default);
+extern u32 CmdlineGetNumber(const char *Key, u32 Default);
+extern bool CmdlineGetBool(const char *Key, bool Default);
+extern bool CmdlineEquals(const char *s1, const char *s2);
+extern bool CmdlineListContains(const char *List, const char *Item);
+
+#endif //_CMDLINE_H
@@ -14,7 +14,17 @@ extern void SetupScreen();
 extern void printf(const char *szFormat, ...);
 extern void ChangeColors(u32 Foreground, u32 Background);
 extern int vsprintf(char *buf, const char *fmt, va_list args);
+extern int sprintf(char *buf, const char *fmt, ...);
+extern unsigned long simple_strtoul(const char *cp, char **endp, unsigned int base);
+extern void LogPrintf(const char *szFormat, ...);
+extern void PrintToSerial(const char *szBuffer);
+extern void SerialWrite(const char *szBuffer);
+extern void SplashInit();
+extern void SplashProgress(u32 Phase);
 extern bool WrapperVerbose;
+extern char LoaderLog[];
+extern u32 LoaderLogLength;
+extern u32 LogSinks;
 
 typedef enum {
     Blue = 0,
@@ -23,10 +33,43 @@ typedef enum {
     Reserved,
 } FrameBufferColors;
 
+/* Loader phases shown on the splash progress bar */
+typedef enum {
+    SplashPhaseStart = 0,
+    SplashPhasePayloads,
+    SplashPhaseKernelCopied,
+    SplashPhaseBootParams,
+    SplashPhaseLinux,
+} SplashPhases;
+
+/* Pre-converted boot logo in __TEXT,__splash, generated by tools/mksplash.py */
+typedef struct {
+    u32 Magic; /* SPLASH_MAGIC */
+    u32 Width; /* Logo width in pixels */
+    u32 Height; /* Logo height in pixels */
+    u32 RunBytes; /* Size of the run data following this header */
+} SPLASH_HEADER, *PSPLASH_HEADER;
+
+#define SPLASH_MAGIC            0x534C5053 /* 'SPLS' */
+#define SPLASH_RUN_LITERAL      0x80000000 /* Run is followed by one color per pixel instead of a single color */
+#define SPLASH_BACKGROUND       0x00000000
+#define SPLASH_BAR_WIDTH        256
+#define SPLASH_BAR_HEIGHT       6
+#define SPLASH_BAR_GAP          32 /* Space between logo and progress bar */
+#define SPLASH_BAR_EMPTY        0x00303030
+#define SPLASH_BAR_FULL         0x00D0D0D0
+
 #define COM1 0x3F8
 
-#define debug_printf(...)   if (WrapperVerbose) \
-                            printf(__VA_ARGS__)
+#define LOADER_LOG_SIZE 0x4000
+
+/* Where printf() output goes, see atvloader.log */
+#define LOG_SINK_SCREEN         0x1
+#define LOG_SINK_SERIAL         0x2
+#define LOG_SINK_MEMORY         0x4
+
+#define debug_printf(...)   (WrapperVerbose ? printf(__VA_ARGS__) : \
+                            LogPrintf(__VA_ARGS__))
 
 #define trace(...)          debug_printf("(%s:%d) TRACE: ", __FILE__, __LINE__); \
                             debug_printf(__VA_ARGS__)
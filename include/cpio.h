@@ -0,0 +1,23 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the loader-generated initramfs for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _CPIO_H
+#define _CPIO_H
+
+#define CPIO_NEWC_MAGIC         "070701"
+#define CPIO_NEWC_HEADER_SIZE   110
+#define CPIO_ALIGN(x)           (((x) + 3) & ~3)
+
+#define CPIO_MODE_DIRECTORY     0040755
+#define CPIO_MODE_FILE          0100444
+
+/* Directory in the initramfs root holding the files written by this loader */
+#define CPIO_LOADER_DIRECTORY   "atvloader"
+
+extern void AppendLoaderCpio(const u8 **InitrdPtr, u32 *InitrdLen, u8 *Reserve, u32 ReserveLength);
+
+#endif //_CPIO_H
@@ -0,0 +1,208 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the EHCI USB host controller driver for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _EHCI_H
+#define _EHCI_H
+
+/* Capability registers */
+#define EHCI_CAPLENGTH          0x00
+#define EHCI_HCSPARAMS          0x04
+#define EHCI_HCCPARAMS          0x08
+
+#define EHCI_HCSPARAMS_PPC      (1 << 4) /* Port power control */
+
+/* Operational registers, relative to CAPLENGTH */
+#define EHCI_USBCMD             0x00
+#define EHCI_USBSTS             0x04
+#define EHCI_USBINTR            0x08
+#define EHCI_CTRLDSSEGMENT      0x10
+#define EHCI_ASYNCLISTADDR      0x18
+#define EHCI_CONFIGFLAG         0x40
+#define EHCI_PORTSC(n)          (0x44 + ((n) * 4))
+
+#define EHCI_CMD_RUN            (1 << 0)
+#define EHCI_CMD_HCRESET        (1 << 1)
+#define EHCI_CMD_ASE            (1 << 5) /* Asynchronous schedule enable */
+#define EHCI_CMD_ITC_1MS        (8 << 16) /* Interrupt threshold, 8 microframes */
+
+#define EHCI_STS_HCHALTED       (1 << 12)
+#define EHCI_STS_ASS            (1 << 15) /* Asynchronous schedule status */
+
+#define EHCI_PORT_CCS           (1 << 0) /* Current connect status */
+#define EHCI_PORT_CSC           (1 << 1) /* Connect status change */
+#define EHCI_PORT_PE            (1 << 2) /* Port enabled */
+#define EHCI_PORT_PEC           (1 << 3) /* Port enable change */
+#define EHCI_PORT_OCC           (1 << 5) /* Over-current change */
+#define EHCI_PORT_PR            (1 << 8) /* Port reset */
+#define EHCI_PORT_LS_MASK       (3 << 10) /* Line status */
+#define EHCI_PORT_LS_K          (1 << 10) /* K-state means a low speed device */
+#define EHCI_PORT_PP            (1 << 12) /* Port power */
+#define EHCI_PORT_OWNER         (1 << 13) /* Owned by the companion controller */
+#define EHCI_PORT_RWC           (EHCI_PORT_CSC | EHCI_PORT_PEC | EHCI_PORT_OCC)
+
+/* USB legacy support extended capability, in PCI configuration space */
+#define EHCI_LEGSUP_ID          0x01
+#define EHCI_LEGSUP_BIOS_OWNED  (1 << 16)
+#define EHCI_LEGSUP_OS_OWNED    (1 << 24)
+
+/* Link pointers */
+#define EHCI_TERMINATE          1
+#define EHCI_TYPE_QH            (1 << 1)
+
+/* qTD token */
+#define EHCI_TOKEN_ACTIVE       (1 << 7)
+#define EHCI_TOKEN_HALTED       (1 << 6)
+/* Only meaningful once the qTD halted; a transaction error that was retried successfully also leaves its bit set */
+#define EHCI_TOKEN_BUFFER_ERROR (1 << 5)
+#define EHCI_TOKEN_BABBLE       (1 << 4)
+#define EHCI_TOKEN_XACT_ERROR   (1 << 3)
+#define EHCI_TOKEN_MISSED_UFRAME (1 << 2)
+#define EHCI_TOKEN_PID_OUT      0
+#define EHCI_TOKEN_PID_IN       1
+#define EHCI_TOKEN_PID_SETUP    2
+#define EHCI_TOKEN_CERR         (3 << 10)
+#define EHCI_TOKEN_IOC          (1 << 15)
+#define EHCI_TOKEN_TOGGLE       (1 << 31)
+#define EHCI_TOKEN_BYTES(t)     (((t) >> 16) & 0x7FFF)
+
+/* QH endpoint characteristics */
+#define EHCI_QH_EPS_HIGH        (2 << 12)
+#define EHCI_QH_DTC             (1 << 14) /* Data toggle comes from the qTD */
+#define EHCI_QH_HEAD            (1 << 15) /* Head of reclamation list */
+#define EHCI_QH_NAK_RELOAD      (4 << 28)
+#define EHCI_QH_MULT_1          (1 << 30)
+
+/* Queue element transfer descriptor. Hardware needs 32-byte alignment; 64 keeps them on separate cache lines. */
+typedef struct {
+    volatile u32 Next; /* Next qTD */
+    volatile u32 AltNext; /* Next qTD on a short packet */
+    volatile u32 Token; /* Status, PID, length and toggle */
+    volatile u32 Buffer[5]; /* Buffer page pointers; the first one carries the offset */
+    volatile u32 BufferHigh[5]; /* Upper 32 bits for 64-bit capable controllers */
+} __aligned(64) EHCI_QTD, *PEHCI_QTD;
+
+/* Queue head; the transfer overlay has the same layout as the start of a qTD */
+typedef struct {
+    volatile u32 HorizontalLink; /* Next QH in the asynchronous schedule */
+    volatile u32 Characteristics; /* Address, endpoint, speed, max packet */
+    volatile u32 Capabilities; /* Split transaction and bandwidth data */
+    volatile u32 CurrentQtd; /* qTD being executed */
+    volatile u32 Next; /* Overlay: next qTD */
+    volatile u32 AltNext; /* Overlay: next qTD on a short packet */
+    volatile u32 Token; /* Overlay: status and data toggle */
+    volatile u32 Buffer[5];
+    volatile u32 BufferHigh[5];
+} __aligned(64) EHCI_QH, *PEHCI_QH;
+
+/* One transfer of at least 16K per qTD, so 128 of them cover a 2MB request */
+#define EHCI_QTD_COUNT          160
+#define EHCI_QH_COUNT           12
+#define EHCI_MAX_DEVICES        4
+#define EHCI_TIMEOUT_MS         5000
+
+/* USB standard definitions */
+#define USB_DIR_IN              0x80
+#define USB_TYPE_CLASS          0x20
+#define USB_RECIP_INTERFACE     0x01
+#define USB_RECIP_ENDPOINT      0x02
+
+#define USB_REQ_CLEAR_FEATURE       1
+#define USB_REQ_SET_ADDRESS         5
+#define USB_REQ_GET_DESCRIPTOR      6
+#define USB_REQ_SET_CONFIGURATION   9
+#define USB_FEATURE_ENDPOINT_HALT   0
+
+#define USB_DT_DEVICE           1
+#define USB_DT_CONFIG           2
+#define USB_DT_INTERFACE        4
+#define USB_DT_ENDPOINT         5
+
+#define USB_ENDPOINT_BULK       2
+#define USB_CONFIG_MAX          256
+
+typedef struct {
+    u8 RequestType;
+    u8 Request;
+    u16 Value;
+    u16 Index;
+    u16 Length;
+} __attribute__((packed)) USB_SETUP_PACKET, *PUSB_SETUP_PACKET;
+
+typedef struct {
+    u8 Length;
+    u8 DescriptorType;
+    u16 UsbVersion;
+    u8 DeviceClass;
+    u8 DeviceSubclass;
+    u8 DeviceProtocol;
+    u8 MaxPacketSize0;
+    u16 VendorId;
+    u16 ProductId;
+    u16 DeviceVersion;
+    u8 Manufacturer;
+    u8 Product;
+    u8 SerialNumber;
+    u8 NumConfigurations;
+} __attribute__((packed)) USB_DEVICE_DESCRIPTOR, *PUSB_DEVICE_DESCRIPTOR;
+
+typedef struct {
+    u8 Length;
+    u8 DescriptorType;
+    u16 TotalLength;
+    u8 NumInterfaces;
+    u8 ConfigurationValue;
+    u8 Configuration;
+    u8 Attributes;
+    u8 MaxPower;
+} __attribute__((packed)) USB_CONFIG_DESCRIPTOR, *PUSB_CONFIG_DESCRIPTOR;
+
+typedef struct {
+    u8 Length;
+    u8 DescriptorType;
+    u8 InterfaceNumber;
+    u8 AlternateSetting;
+    u8 NumEndpoints;
+    u8 InterfaceClass;
+    u8 InterfaceSubclass;
+    u8 InterfaceProtocol;
+    u8 Interface;
+} __attribute__((packed)) USB_INTERFACE_DESCRIPTOR, *PUSB_INTERFACE_DESCRIPTOR;
+
+typedef struct {
+    u8 Length;
+    u8 DescriptorType;
+    u8 EndpointAddress;
+    u8 Attributes;
+    u16 MaxPacketSize;
+    u8 Interval;
+} __attribute__((packed)) USB_ENDPOINT_DESCRIPTOR, *PUSB_ENDPOINT_DESCRIPTOR;
+
+/* A configured high speed device on a root port */
+typedef struct {
+    u8 Address; /* USB device address */
+    u8 Port; /* Root hub port */
+    PEHCI_QH Control; /* Default control pipe */
+    USB_DEVICE_DESCRIPTOR Descriptor; /* Device descriptor */
+    u8 Config[USB_CONFIG_MAX]; /* Active configuration descriptor and everything after it */
+    u16 ConfigLength; /* Valid bytes in Config */
+} USB_DEVICE, *PUSB_DEVICE;
+
+extern u32 EhciInit();
+extern void EhciShutdown();
+extern PUSB_DEVICE EhciGetDevice(u32 Index);
+extern PEHCI_QH EhciOpenPipe(u8 Address, u8 Endpoint, u16 MaxPacket, bool Control);
+extern bool EhciControlTransfer(PUSB_DEVICE Device, PUSB_SETUP_PACKET Setup, void *Data);
+extern bool EhciClearHalt(PUSB_DEVICE Device, PEHCI_QH Pipe, u8 EndpointAddress);
+
+/* Queueing interface for class drivers that chain several transfers */
+extern void EhciFreeQtds();
+extern PEHCI_QTD EhciBuildChain(u8 Pid, void *Data, u32 Length, PEHCI_QTD Next, PEHCI_QTD AltNext,
+                                PEHCI_QTD *Last);
+extern void EhciSubmit(PEHCI_QH Pipe, PEHCI_QTD First);
+extern bool EhciWait(PEHCI_QH Pipe, PEHCI_QTD Last);
+
+#endif //_EHCI_H
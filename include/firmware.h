@@ -6,6 +6,10 @@
 extern int memcmp(const void *cs,const void *ct, size_t count);
 extern void print_e820_memory_map(struct boot_params *boot_params);
 extern void fill_e820map(struct boot_params *boot_params);
+extern void *find_free_memory(u32 size, u32 minimum);
+#ifdef HOST_BUILD
+extern void HostStartLinux(struct boot_params *boot_params, u32 entry); /* See host/ */
+#endif
 
 
 /* https://github.com/loop333/atv-bootloader/blob/master/linux_code.h *********/
@@ -0,0 +1,107 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the read-only filesystem layer for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _FS_H
+#define _FS_H
+
+#define FS_SECTOR_SIZE          512
+#define FS_SECTOR_SHIFT         9
+#define FS_MAX_DEVICES          (ATA_MAX_DRIVES + USB_STORAGE_MAX_DEVICES)
+#define FS_MAX_VOLUMES          16
+#define FS_MAX_NAME             256
+
+/* Block cache: direct mapped lines of 8K, filled two lines at a time on sequential misses */
+#define FS_CACHE_LINES          32
+#define FS_CACHE_LINE_SHIFT     13
+#define FS_CACHE_LINE_SIZE      (1 << FS_CACHE_LINE_SHIFT)
+#define FS_CACHE_LINE_SECTORS   (FS_CACHE_LINE_SIZE / FS_SECTOR_SIZE)
+
+/* Largest request handed to a block driver by FsReadFile() */
+#define FS_MAX_RUN_SECTORS      4096
+
+/* Passed to extent callbacks for sparse regions, which read as zeroes */
+#define FS_SPARSE               ((u64) -1)
+
+/* Payloads loaded from disk when they are not linked into mach_kernel */
+#define FS_KERNEL_PATH          "/vmlinuz"
+#define FS_INITRD_PATH          "/initrd.img"
+
+typedef bool (*BLOCK_READ)(void *Context, u64 Lba, u32 Count, void *Buffer);
+typedef void (*BLOCK_CHUNK_CALLBACK)(u8 *Data, u32 Length, void *Context);
+typedef bool (*BLOCK_STREAM)(void *Context, u64 Lba, u32 Count, void *Buffer, BLOCK_CHUNK_CALLBACK Callback,
+                             void *CallbackContext);
+
+typedef struct {
+    BLOCK_READ Read; /* Driver read function */
+    BLOCK_STREAM Stream; /* Read calling back with each chunk while the next one transfers, NULL if unsupported */
+    void *Context; /* Driver device */
+    u64 SectorCount; /* Size in 512 byte sectors */
+} BLOCK_DEVICE, *PBLOCK_DEVICE;
+
+typedef enum {
+    FsTypeNone = 0,
+    FsTypeFat32,
+    FsTypeExt4,
+} FS_TYPE;
+
+typedef struct {
+    PBLOCK_DEVICE Device; /* Device holding this volume */
+    u64 StartSector; /* First sector of the partition */
+    u64 SectorCount; /* Size of the partition */
+    FS_TYPE Type; /* Filesystem found on the partition */
+    union {
+        struct {
+            u32 SectorsPerCluster;
+            u32 FatStart; /* Relative to StartSector */
+            u32 DataStart; /* Relative to StartSector */
+            u32 RootCluster;
+            u32 ClusterCount;
+        } Fat;
+        struct {
+            u32 BlockSize;
+            u32 SectorsPerBlock;
+            u32 InodesPerGroup;
+            u32 InodeSize;
+            u32 DescriptorSize;
+            u32 DescriptorBlock; /* First block of the group descriptor table */
+        } Ext4;
+    };
+} FS_VOLUME, *PFS_VOLUME;
+
+typedef struct {
+    PFS_VOLUME Volume; /* Volume the file lives on */
+    u64 Size; /* Size in bytes */
+    u32 Id; /* First cluster (FAT) or inode number (ext4) */
+    bool Directory; /* File is a directory */
+} FS_FILE, *PFS_FILE;
+
+/* Called for each run of sectors in file order; return FALSE to stop */
+typedef bool (*FS_EXTENT_CALLBACK)(u64 Sector, u32 Count, void *Context);
+
+extern u32 FsInit();
+extern u32 FsAddDevice(PBLOCK_DEVICE Device);
+extern void FsShutdown();
+extern bool FsOpen(const char *Path, PFS_FILE File);
+extern bool FsReadFile(PFS_FILE File, void *Destination);
+extern bool FsReadFileRange(PFS_FILE File, u64 Offset, u32 Length, void *Destination, BLOCK_CHUNK_CALLBACK Callback,
+                            void *Context);
+
+/* Shared with the filesystem drivers */
+extern bool FsCacheRead(PBLOCK_DEVICE Device, u64 ByteOffset, void *Destination, u32 Length);
+extern bool FsNameEquals(const char *Name, u32 NameLength, const char *Other, u32 OtherLength);
+
+extern bool FatMount(PFS_VOLUME Volume);
+extern void FatRoot(PFS_VOLUME Volume, PFS_FILE File);
+extern bool FatLookup(PFS_FILE Directory, const char *Name, u32 NameLength, PFS_FILE File);
+extern bool FatMapExtents(PFS_FILE File, FS_EXTENT_CALLBACK Callback, void *Context);
+
+extern bool Ext4Mount(PFS_VOLUME Volume);
+extern bool Ext4Root(PFS_VOLUME Volume, PFS_FILE File);
+extern bool Ext4Lookup(PFS_FILE Directory, const char *Name, u32 NameLength, PFS_FILE File);
+extern bool Ext4MapExtents(PFS_FILE File, FS_EXTENT_CALLBACK Callback, void *Context);
+
+#endif //_FS_H
@@ -10,7 +10,27 @@
 
 extern void outb(uint16_t port, uint8_t val);
 extern uint8_t inb(uint16_t port);
+extern void outw(uint16_t port, uint16_t val);
+extern uint16_t inw(uint16_t port);
+extern void insw(uint16_t port, void *buf, uint32_t count);
 extern void outl(uint16_t port, uint32_t val);
 extern uint32_t inl(uint16_t port);
 
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+#define PCI_VENDOR_ID       0x00 /* Vendor ID (low 16 bits), device ID (high 16 bits) */
+#define PCI_COMMAND         0x04 /* Command (low 16 bits), status (high 16 bits) */
+#define PCI_CLASS_REVISION  0x08 /* Class, subclass, prog-if, revision */
+#define PCI_HEADER_TYPE     0x0C /* Header type is bits 16-23 */
+#define PCI_BAR0            0x10
+
+#define PCI_COMMAND_IO      (1 << 0)
+#define PCI_COMMAND_MEMORY  (1 << 1)
+#define PCI_COMMAND_MASTER  (1 << 2)
+
+extern uint32_t PciConfigRead32(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset);
+extern void PciConfigWrite32(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t val);
+extern bool PciFindClass(uint8_t class, uint8_t subclass, uint32_t index, uint8_t *device, uint8_t *function);
+
 #endif //_IOPORTS_H
@@ -14,6 +14,13 @@
 #include "mach.h"
 #include "linux_params.h"
 #include "firmware.h"
+#include "cpio.h"
+#include "ata.h"
+#include "ehci.h"
+#include "usbstorage.h"
+#include "fs.h"
+#include "timeline.h"
+#include "cmdline.h"
 
 // from assembly
 extern void fail();
\ No newline at end of file
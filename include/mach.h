@@ -60,6 +60,10 @@ extern PMACH_BOOTARGS BootArgs;
 
 #define MACHO_LC_SEGMENT 0x1 /* Segment to be mapped */
 
+/* Last segment of the image, holding the kernel, initrd and initramfs reserve so that tools/machopack.py can
+ * resize them without moving any code or data. */
+#define MACHO_PAYLOAD_SEGMENT "__PAYLOAD"
+
 /* Mach-O header */
 typedef struct {
     u32 MagicNumber; /* Mach-O magic number. */
@@ -114,7 +118,12 @@ typedef struct {
     u32 Reserved2;
 } MACHO_SECTION, *PMACHO_SECTION;
 
+#ifdef HOST_BUILD
+extern PMACHO_HEADER HostMachHeader; /* Image built by the host harness, see host/ */
+#define _mh_execute_header (*HostMachHeader)
+#else
 extern MACHO_HEADER _mh_execute_header; /* Defined by Mach-O linker */
+#endif
 
 extern u8 *GetSectionDataFromHeader(PMACHO_HEADER Header, const char *SegmentName, const char *SectionName,
                                     u32 *Size);
\ No newline at end of file
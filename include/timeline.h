@@ -0,0 +1,22 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the boot timeline for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _TIMELINE_H
+#define _TIMELINE_H
+
+#define TIMELINE_MAX_MARKS      16
+#define TIMELINE_HEADER         "Boot timeline (phase, kcycles total, kcycles in phase):\n"
+
+typedef struct {
+    const char *Name; /* Phase that just finished */
+    u64 Timestamp; /* TSC at the end of the phase */
+} TIMELINE_MARK, *PTIMELINE_MARK;
+
+extern void TimelineMark(const char *Name);
+extern u32 TimelineFormat(char *Buffer, u32 Size);
+
+#endif //_TIMELINE_H
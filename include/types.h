@@ -15,7 +15,11 @@ typedef __UINTPTR_TYPE__    uintptr_t;
 
 typedef short			    CHAR16;
 typedef void			    VOID;
+#ifdef HOST_BUILD
+typedef unsigned int        UINTN; /* 64-bit host builds keep the 32-bit sizes, see host/ */
+#else
 typedef unsigned long       UINTN;
+#endif
 typedef uint8_t			    UINT8;
 typedef UINT8			    CHAR8;
 typedef int16_t			    INT16;
@@ -27,11 +31,19 @@ typedef unsigned long long  UINT64;
 
 typedef unsigned char       u8;
 typedef unsigned short      u16;
+#ifdef HOST_BUILD
+typedef unsigned int        u32;
+#else
 typedef unsigned long       u32;
+#endif
 typedef unsigned long long  u64;
 typedef char                s8;
 typedef short               s16;
+#ifdef HOST_BUILD
+typedef int                 s32;
+#else
 typedef long                s32;
+#endif
 typedef long long           s64;
 typedef char                bool;
 
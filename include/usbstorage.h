@@ -0,0 +1,66 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Header file for the USB mass storage driver for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+#ifndef _USBSTORAGE_H
+#define _USBSTORAGE_H
+
+#define USB_CLASS_MASS_STORAGE      0x08
+#define USB_SUBCLASS_SCSI           0x06
+#define USB_PROTOCOL_BULK_ONLY      0x50
+
+#define USB_STORAGE_RESET           0xFF /* Bulk-Only Mass Storage Reset class request */
+
+#define USB_STORAGE_CBW_SIGNATURE   0x43425355 /* 'USBC' */
+#define USB_STORAGE_CSW_SIGNATURE   0x53425355 /* 'USBS' */
+#define USB_STORAGE_CBW_IN          0x80
+
+#define USB_STORAGE_MAX_DEVICES     2
+/* Largest single READ(10); one CBW, one CSW and the data qTDs must fit in the EHCI qTD pool */
+#define USB_STORAGE_MAX_TRANSFER    0x200000
+
+#define SCSI_TEST_UNIT_READY        0x00
+#define SCSI_REQUEST_SENSE          0x03
+#define SCSI_INQUIRY                0x12
+#define SCSI_READ_CAPACITY_10       0x25
+#define SCSI_READ_10                0x28
+
+/* Command block wrapper */
+typedef struct {
+    u32 Signature;
+    u32 Tag;
+    u32 DataTransferLength;
+    u8 Flags;
+    u8 Lun;
+    u8 CommandLength;
+    u8 Command[16];
+} __attribute__((packed)) USB_STORAGE_CBW, *PUSB_STORAGE_CBW;
+
+/* Command status wrapper */
+typedef struct {
+    u32 Signature;
+    u32 Tag;
+    u32 DataResidue;
+    u8 Status;
+} __attribute__((packed)) USB_STORAGE_CSW, *PUSB_STORAGE_CSW;
+
+typedef struct {
+    PUSB_DEVICE Device; /* Underlying USB device */
+    PEHCI_QH BulkIn; /* Bulk IN pipe */
+    PEHCI_QH BulkOut; /* Bulk OUT pipe */
+    u8 BulkInAddress; /* Endpoint addresses, for clearing stalls */
+    u8 BulkOutAddress;
+    u8 Interface; /* Interface number */
+    u32 Tag; /* Tag of the last command */
+    u32 BlockSize; /* Logical block size in bytes */
+    u32 BlockCount; /* Number of logical blocks */
+} USB_STORAGE, *PUSB_STORAGE;
+
+extern u32 UsbStorageInit();
+extern PUSB_STORAGE UsbStorageGetDevice(u32 Index);
+extern bool UsbStorageReadBlocks(PUSB_STORAGE Storage, u32 Lba, u32 Count, void *Buffer);
+
+#endif //_USBSTORAGE_H
@@ -19,5 +19,6 @@ extern size_t	strlen(const char *s);
 extern void*	memcpy(void * to, const void *from, size_t n);
 extern void*	memset(void *s, int c,  size_t count);
 extern int		memcmp(const void *cs, const void *ct, size_t count);
+extern u32		crc32(u32 crc, const void *buf, size_t len);
 
 #endif
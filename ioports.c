@@ -21,6 +21,21 @@ uint8_t inb(uint16_t port) {
     return ret;
 }
 
+void outw(uint16_t port, uint16_t val) {
+    __asm__ __volatile__ ( "outw %0, %1" : : "a"(val), "Nd"(port) );
+}
+
+uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    __asm__ __volatile__ ( "inw %1, %0" : "=a"(ret) : "Nd"(port) );
+    return ret;
+}
+
+/* Read count 16-bit words from port into buf */
+void insw(uint16_t port, void *buf, uint32_t count) {
+    __asm__ __volatile__ ( "rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory" );
+}
+
 void outl(uint16_t port, uint32_t val) {
     __asm__ __volatile__ ("out" "l" " %" "0,%" "w" "1"::"a" (val), "Nd" (port));
 }
@@ -31,3 +46,41 @@ uint32_t inl(uint16_t port) {
     return ret;
 }
 
+/* PCI configuration mechanism #1 */
+static
+void PciSelect(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | (bus << 16) | (device << 11) | (function << 8) | (offset & 0xFC));
+}
+
+uint32_t PciConfigRead32(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    PciSelect(bus, device, function, offset);
+    return inl(PCI_CONFIG_DATA);
+}
+
+void PciConfigWrite32(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t val) {
+    PciSelect(bus, device, function, offset);
+    outl(PCI_CONFIG_DATA, val);
+}
+
+/* Find the index'th device with the given class and subclass. The Apple TV's chipset devices all live on bus 0. */
+bool PciFindClass(uint8_t class, uint8_t subclass, uint32_t index, uint8_t *device, uint8_t *function) {
+    for (uint8_t dev = 0; dev < 32; dev++) {
+        for (uint8_t fn = 0; fn < 8; fn++) {
+            if ((PciConfigRead32(0, dev, fn, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) {
+                if (fn == 0)
+                    break;
+                continue;
+            }
+            uint32_t class_revision = PciConfigRead32(0, dev, fn, PCI_CLASS_REVISION);
+            if ((class_revision >> 24) == class && ((class_revision >> 16) & 0xFF) == subclass && index-- == 0) {
+                *device = dev;
+                *function = fn;
+                return TRUE;
+            }
+            /* only probe other functions of multi-function devices */
+            if (fn == 0 && !(PciConfigRead32(0, dev, fn, PCI_HEADER_TYPE) & 0x800000))
+                break;
+        }
+    }
+    return FALSE;
+}
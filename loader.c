@@ -17,7 +17,19 @@ PMACH_BOOTARGS BootArgs;
 #define VERSION_MINOR 0
 #define VERSION_PATCH 0
 
+#define DISK_PAYLOAD_BASE 0x04000000
+
 void *relocated_kernel_start = (void *) 0x00100000; // kernel will always be loaded to 1MB
+u32 disk_payload_minimum = DISK_PAYLOAD_BASE; // payloads read from disk stay clear of the kernel's decompression area
+
+// Loader options from the command line, see SetupCmdline() and include/cmdline.h
+const char *disk_kernel_path = FS_KERNEL_PATH;
+const char *disk_initrd_path = FS_INITRD_PATH;
+bool splash_enabled = TRUE;
+bool benchmark_mode = FALSE;
+bool direct_kernel_copy = FALSE;
+bool verify_payloads = FALSE;
+bool kernel_relocated = FALSE; // protected mode kernel was read from disk straight to relocated_kernel_start
 
 // Descriptor table base addresses & limits for Linux startup.
 dt_addr_t gdt_addr = { 0x800, 0x94000 };
@@ -81,15 +93,39 @@ uint32_t init_gdt_size = sizeof(init_gdt);
 
 /* FUNCTIONS ******************************************************************/
 
-/* Set up command line and enable verbose mode */
+/* Set up command line, read loader options and enable verbose mode */
 static
 void SetupCmdline() {
+    /* Tokenize once; atvloader.* options are removed from what Linux gets */
+    CmdlineParse(BootArgs->CmdLine);
+
+    const char *sinks = CmdlineGetString(CMDLINE_LOADER_PREFIX "log", NULL);
+    if (sinks) {
+        LogSinks = (CmdlineListContains(sinks, "screen") ? LOG_SINK_SCREEN : 0) |
+                   (CmdlineListContains(sinks, "serial") ? LOG_SINK_SERIAL : 0) |
+                   (CmdlineListContains(sinks, "memory") ? LOG_SINK_MEMORY : 0);
+    }
+    splash_enabled = CmdlineGetBool(CMDLINE_LOADER_PREFIX "splash", TRUE);
+    benchmark_mode = CmdlineGetBool(CMDLINE_LOADER_PREFIX "benchmark", FALSE);
+    verify_payloads = CmdlineGetBool(CMDLINE_LOADER_PREFIX "verify", FALSE);
+    disk_payload_minimum = CmdlineGetNumber(CMDLINE_LOADER_PREFIX "payload_base", disk_payload_minimum);
+    disk_kernel_path = CmdlineGetString(CMDLINE_LOADER_PREFIX "kernel", disk_kernel_path);
+    disk_initrd_path = CmdlineGetString(CMDLINE_LOADER_PREFIX "initrd", disk_initrd_path);
+
+    const char *copy = CmdlineGetString(CMDLINE_LOADER_PREFIX "copy", "staged");
+    if (CmdlineEquals(copy, "direct")) {
+        direct_kernel_copy = TRUE;
+    } else if (!CmdlineEquals(copy, "staged")) {
+        warn("Unknown copy strategy %s, using staged\n", copy);
+    }
+
     /* Check if we should enable verbose mode */
-    if (strstr(BootArgs->CmdLine, "-v")) {
+    if (CmdlineFind("-v") || CmdlineGetBool(CMDLINE_LOADER_PREFIX "verbose", FALSE)) {
         /* Enable verbose printing in freeldr-wrapper-appletv */
         ClearScreen(TRUE);
         debug_printf("Booting in Verbose Mode. ");
     }
+    debug_printf("%u loader options. ", CmdlineLoaderOptionCount());
 }
 
 /* Get RSDP */
@@ -129,13 +165,18 @@ void *AcpiGetRsdp() {
 
 /* Load Linux kernel */
 static
-void LoadLinux(struct boot_params *boot_params, const u8 *kernel_ptr, u32 kernel_len, const u8 *initrd_ptr, u32 initrd_len) {
+void LoadLinux(struct boot_params *boot_params, const u8 *kernel_ptr, u32 kernel_len, const u8 *initrd_ptr, u32 initrd_len,
+               u8 *cpio_ptr, u32 cpio_len) {
     // find actual linux kernel length
     u32 real_kernel_len = kernel_len - ((kernel_ptr[0x1F1] + 1) * 512);
     // copy the linux kernel to the relocated location
-    trace("Copying Linux kernel to 0x%X...\n", relocated_kernel_start);
-    memcpy(relocated_kernel_start, &kernel_ptr[(kernel_ptr[0x1F1] + 1) * 512], real_kernel_len);
-    trace("done.\n");
+    if (!kernel_relocated) {
+        trace("Copying Linux kernel to 0x%X...\n", relocated_kernel_start);
+        memcpy(relocated_kernel_start, &kernel_ptr[(kernel_ptr[0x1F1] + 1) * 512], real_kernel_len);
+        trace("done.\n");
+    }
+    SplashProgress(SplashPhaseKernelCopied);
+    TimelineMark("kernel-copy");
     // zero boot parameters
     memset(boot_params, 0, sizeof(struct boot_params)); // 4096
     // set up the linux setup_header
@@ -163,13 +204,6 @@ void LoadLinux(struct boot_params *boot_params, const u8 *kernel_ptr, u32 kernel
 
     setup_header->loadflags &= ~(1 << 5); // print early messages
 
-    // set up initial ramdisk
-    if(initrd_len != 0) {
-        trace("Setting up initial ramdisk.\n");
-        setup_header->ramdisk_image = (u32) initrd_ptr;
-        setup_header->ramdisk_size  = initrd_len;
-    }
-
     // set up video
     struct screen_info *screen_info = &boot_params->screen_info;
 
@@ -205,12 +239,48 @@ void LoadLinux(struct boot_params *boot_params, const u8 *kernel_ptr, u32 kernel
     // setup e820 memory map
     fill_e820map(boot_params);
     print_e820_memory_map(boot_params);
+    SplashProgress(SplashPhaseBootParams);
+    TimelineMark("boot-params");
+
+    // append loader-generated initramfs, then set up initial ramdisk
+    AppendLoaderCpio(&initrd_ptr, &initrd_len, cpio_ptr, cpio_len);
+    if(initrd_len != 0) {
+        trace("Setting up initial ramdisk.\n");
+        setup_header->ramdisk_image = (u32) initrd_ptr;
+        setup_header->ramdisk_size  = initrd_len;
+    }
 
     // GO!!
+    SplashProgress(SplashPhaseLinux);
+    TimelineMark("linux");
+    // the timeline always goes out on the serial port, whatever atvloader.log says, so boot time can be measured on
+    // non-verbose boots too
+    char timeline[TIMELINE_MAX_MARKS * 80];
+    TimelineFormat(timeline, sizeof(timeline));
+    if (WrapperVerbose) {
+        printf("%s%s", TIMELINE_HEADER, timeline);
+    }
+    if (!WrapperVerbose || !(LogSinks & LOG_SINK_SERIAL)) {
+        SerialWrite(TIMELINE_HEADER);
+        SerialWrite(timeline);
+    }
+    if (benchmark_mode) {
+        printf("Benchmark mode, not starting Linux. System halted.\n");
+        for (;;) {
+            asm volatile ( "cli; hlt" : : );
+        }
+    }
+    // the USB controller must not keep walking its schedule once Linux reuses loader memory
+    FsShutdown();
+
     // Initialize Linux GDT.
     memset((void *) gdt_addr.base, 0x00, gdt_addr.limit);
     memcpy((void *) gdt_addr.base, init_gdt, init_gdt_size);
 
+#ifdef HOST_BUILD
+    // host builds (see host/) hand boot_params to the harness instead of leaving the loader
+    HostStartLinux(boot_params, (u32) relocated_kernel_start);
+#else
     // Load descriptor table pointers.
     asm volatile ( "lidt %0" : : "m" (idt_addr) );
     asm volatile ( "lgdt %0" : : "m" (gdt_addr) );
@@ -224,16 +294,139 @@ void LoadLinux(struct boot_params *boot_params, const u8 *kernel_ptr, u32 kernel
 
     // Jump to kernel entry point.
     asm volatile ( "jmp *%%ecx" : : );
+#endif
+}
+
+/* Running CRC-32 of a payload; on ATA this runs on one chunk while the next one is transferred */
+static
+void ChecksumChunk(u8 *data, u32 length, void *context) {
+    *(u32 *) context = crc32(*(u32 *) context, data, length);
+}
+
+/* Compare the CRC-32 of a payload with <path>.crc32 (eight hex digits) if that file exists */
+static
+void VerifyPayload(const char *path, u32 crc) {
+    char crc_path[MACH_CMDLINE + 8];
+    char expected[16];
+    FS_FILE crc_file;
+
+    sprintf(crc_path, "%s.crc32", path);
+    if (!FsOpen(crc_path, &crc_file) || crc_file.Directory || crc_file.Size == 0 ||
+        crc_file.Size >= sizeof(expected)) {
+        debug_printf("%s has CRC-32 %08X, no %s to check against\n", path, crc, crc_path);
+        return;
+    }
+    memset(expected, 0, sizeof(expected));
+    if (!FsReadFile(&crc_file, expected)) {
+        fatal("Could not load %s!\n", crc_path);
+    }
+    if (simple_strtoul(expected, NULL, 16) != crc) {
+        fatal("%s is corrupt: CRC-32 is %08X, %s says %s\n", path, crc, crc_path, expected);
+    }
+    debug_printf("%s has CRC-32 %08X, verified\n", path, crc);
+}
+
+/* End of the memory the kernel occupies at relocated_kernel_start, including the area it decompresses into */
+static
+u32 KernelEnd(struct setup_header *header, u32 kernel_len) {
+    u32 end = (u32) relocated_kernel_start + kernel_len - (header->setup_sects + 1) * 512;
+
+    // init_size is only there from boot protocol 2.10 on
+    if (header->header == 'SrdH' && header->version >= 0x020A &&
+        (u32) relocated_kernel_start + header->init_size > end) {
+        end = (u32) relocated_kernel_start + header->init_size;
+    }
+    return PAGE_ALIGN(end);
+}
+
+/* Load kernel and initrd from the boot partition when they are not linked into mach_kernel */
+static
+void LoadPayloadsFromDisk(u8 **kernel_ptr, u32 *kernel_len, u8 **initrd_ptr, u32 *initrd_len,
+                          u8 **cpio_ptr, u32 cpio_len) {
+    FS_FILE kernel_file, initrd_file;
+    BLOCK_CHUNK_CALLBACK checksum = verify_payloads ? ChecksumChunk : NULL;
+    u32 crc = 0;
+
+    if (!FsInit()) {
+        fatal("No readable volumes found!\n");
+    }
+
+    if (!FsOpen(disk_kernel_path, &kernel_file) || kernel_file.Directory) {
+        fatal("%s not found!\n", disk_kernel_path);
+    }
+    *kernel_len = (u32) kernel_file.Size;
+    u8 boot_sector[0x1F1 + sizeof(struct setup_header)];
+    struct setup_header *header = (struct setup_header *) &boot_sector[0x1F1];
+    if (*kernel_len <= sizeof(boot_sector)) {
+        fatal("%s is not a Linux kernel!\n", disk_kernel_path);
+    }
+    if (!FsReadFileRange(&kernel_file, 0, sizeof(boot_sector), boot_sector, NULL, NULL)) {
+        fatal("Could not load %s!\n", disk_kernel_path);
+    }
+    u32 setup_len = (header->setup_sects + 1) * 512;
+    if (setup_len >= *kernel_len) {
+        fatal("%s is not a Linux kernel!\n", disk_kernel_path);
+    }
+    // with a direct copy only the boot sector and setup code are staged; the protected mode kernel goes straight to
+    // its run address
+    u32 kernel_buffer_len = direct_kernel_copy ? setup_len : *kernel_len;
+    // atvloader.payload_base is unchecked until the kernel's size is known
+    u32 kernel_end = KernelEnd(header, *kernel_len);
+    if (disk_payload_minimum < kernel_end) {
+        warn("Payload base 0x%X is below the end of the kernel at 0x%X, ignoring it\n", disk_payload_minimum,
+             kernel_end);
+        disk_payload_minimum = kernel_end > DISK_PAYLOAD_BASE ? kernel_end : DISK_PAYLOAD_BASE;
+    }
+    *kernel_ptr = find_free_memory(kernel_buffer_len, disk_payload_minimum);
+    if (!*kernel_ptr || !FsReadFileRange(&kernel_file, 0, kernel_buffer_len, *kernel_ptr, checksum, &crc)) {
+        fatal("Could not load %s!\n", disk_kernel_path);
+    }
+    if (direct_kernel_copy) {
+        if (!FsReadFileRange(&kernel_file, kernel_buffer_len, *kernel_len - kernel_buffer_len,
+                             relocated_kernel_start, checksum, &crc)) {
+            fatal("Could not load %s!\n", disk_kernel_path);
+        }
+        kernel_relocated = TRUE;
+    }
+    debug_printf("Loaded %s (%u bytes) to 0x%X%s\n", disk_kernel_path, *kernel_len, *kernel_ptr,
+                 kernel_relocated ? " and 0x100000" : "");
+    if (verify_payloads) {
+        VerifyPayload(disk_kernel_path, crc);
+    }
+
+    if (!FsOpen(disk_initrd_path, &initrd_file) || initrd_file.Directory) {
+        return;
+    }
+    // leave room for the loader initramfs right behind the initrd
+    *initrd_ptr = find_free_memory(CPIO_ALIGN((u32) initrd_file.Size) + cpio_len,
+                                   PAGE_ALIGN((u32) *kernel_ptr + kernel_buffer_len));
+    crc = 0;
+    if (!*initrd_ptr || !FsReadFileRange(&initrd_file, 0, (u32) initrd_file.Size, *initrd_ptr, checksum, &crc)) {
+        fatal("Could not load %s!\n", disk_initrd_path);
+    }
+    *initrd_len = initrd_file.Size;
+    *cpio_ptr = *initrd_ptr + CPIO_ALIGN(*initrd_len);
+    debug_printf("Loaded %s (%u bytes) to 0x%X\n", disk_initrd_path, *initrd_len, *initrd_ptr);
+    if (verify_payloads) {
+        VerifyPayload(disk_initrd_path, crc);
+    }
 }
 
 /* C entry point. */
 void WrapperInit(u32 BootArgPtr) {
+    TimelineMark("entry");
     /* set up bootArgs */
     BootArgs = (PMACH_BOOTARGS) BootArgPtr;
     /* set up screen */
     SetupScreen();
     /* set up command line */
     SetupCmdline();
+    /* show the boot logo unless we are printing text */
+    if (!WrapperVerbose && splash_enabled) {
+        SplashInit();
+        SplashProgress(SplashPhaseStart);
+    }
+    TimelineMark("screen");
     debug_printf("Linux loader for Apple TV version %d.%d.%d (built with %s on %s %s) [%s@%s]\n",
                  VERSION_MAJOR,
                  VERSION_MINOR,
@@ -253,21 +446,29 @@ void WrapperInit(u32 BootArgPtr) {
 
     /* Find Linux kernel */
     u32 kernel_len = 0;
-    u8 *kernel_ptr = GetSectionDataFromHeader(&_mh_execute_header, "__TEXT", "__vmlinuz", &kernel_len);
+    u8 *kernel_ptr = GetSectionDataFromHeader(&_mh_execute_header, MACHO_PAYLOAD_SEGMENT, "__vmlinuz", &kernel_len);
+    /* Find initial ramdisk */
+    u32 initrd_len = 0;
+    u8 *initrd_ptr = GetSectionDataFromHeader(&_mh_execute_header, MACHO_PAYLOAD_SEGMENT, "__initrd", &initrd_len);
+    /* Find space for the loader initramfs */
+    u32 cpio_len = 0;
+    u8 *cpio_ptr = GetSectionDataFromHeader(&_mh_execute_header, MACHO_PAYLOAD_SEGMENT, "__cpio", &cpio_len);
+    if (!kernel_len) {
+        LoadPayloadsFromDisk(&kernel_ptr, &kernel_len, &initrd_ptr, &initrd_len, &cpio_ptr, cpio_len);
+    }
     if (!kernel_len) {
         fatal("Linux kernel not found!\n");
     }
-    /* Find initial ramdisk */
-    u32 initrd_len = 0;
-    u8 *initrd_ptr = GetSectionDataFromHeader(&_mh_execute_header, "__TEXT", "__initrd", &initrd_len);
     if (!initrd_len) {
         warn("No initial ramdisk found! Linux may kernel panic.\n");
     }
+    SplashProgress(SplashPhasePayloads);
+    TimelineMark("payloads");
     u32 *signature = (u32 *)(kernel_ptr + 0x202);
     if (*signature != 'SrdH') {
         fatal("This is not a Linux kernel! Signature is 0x%08X\n", signature);
     }
-    LoadLinux(boot_params, kernel_ptr, kernel_len, initrd_ptr, initrd_len);
+    LoadLinux(boot_params, kernel_ptr, kernel_len, initrd_ptr, initrd_len, cpio_ptr, cpio_len);
 
     fail();
 }
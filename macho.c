@@ -39,7 +39,8 @@ PMACHO_SECTION GetSectionByNameFromHeader(PMACHO_HEADER Header, const char *Segm
                 }
             }
         }
-        Segment = (PMACHO_SEGMENT_COMMAND)((char *) Segment + sizeof(MACHO_SEGMENT_COMMAND));
+        /* Load commands are variable length; a segment command is followed by its sections */
+        Segment = (PMACHO_SEGMENT_COMMAND)((char *) Segment + Segment->CommandSize);
     }
     /* Segment does not exist */
     return (PMACHO_SECTION) 0;
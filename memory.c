@@ -48,7 +48,9 @@ void fill_e820map(struct boot_params *boot_params)
     nr_map = boot_params->efi_info.efi_memmap_size / boot_params->efi_info.efi_memdesc_size;
     e820_map = (struct boot_e820_entry *) boot_params->e820_table;
 
-    for (i = 0, p = (efi_memory_desc_t *) boot_params->efi_info.efi_memmap; i < nr_map; i++) {
+    /* Advance in the loop header, the 640K-1MB fixup below leaves the switch with continue */
+    for (i = 0, p = (efi_memory_desc_t *) boot_params->efi_info.efi_memmap; i < nr_map;
+         i++, p = NextEFIMemoryDescriptor(p, boot_params->efi_info.efi_memdesc_size)) {
         md = p;
         switch (md->type) {
             // ACPI tables -- to be preserved by loader/OS until ACPI is enable
@@ -120,11 +122,35 @@ void fill_e820map(struct boot_params *boot_params)
                                   E820_RESERVED);
                 break;
         }
-        p = (efi_memory_desc_t *) NextEFIMemoryDescriptor(p, boot_params->efi_info.efi_memdesc_size);
     }
     boot_params->e820_entries = e820_nr_map;
 }
 
+/* Find size bytes of conventional memory at or above minimum, page aligned */
+void *find_free_memory(u32 size, u32 minimum)
+{
+    u32               nr_map, i;
+    UINT64            start, end;
+    efi_memory_desc_t *md;
+
+    nr_map = BootArgs->EfiMemoryMapSize / BootArgs->EfiMemoryDescriptorSize;
+    md = (efi_memory_desc_t *) BootArgs->EfiMemoryMap;
+
+    for (i = 0; i < nr_map; i++) {
+        if (md->type == EFI_CONVENTIONAL_MEMORY) {
+            start = md->phys_addr;
+            end   = start + (md->num_pages << EFI_PAGE_SHIFT);
+            if (start < minimum)
+                start = PAGE_ALIGN((UINT64) minimum);
+            // we only hand out memory below 4GB
+            if (start < end && end <= 0x100000000ULL && end - start >= size)
+                return (void *) lo32(start);
+        }
+        md = NextEFIMemoryDescriptor(md, BootArgs->EfiMemoryDescriptorSize);
+    }
+    return NULL;
+}
+
 void print_e820_memory_map(struct boot_params *boot_params)
 {
     int              i;
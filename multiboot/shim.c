@@ -0,0 +1,483 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Multiboot shim that boots mach_kernel under QEMU the way boot.efi does on the Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/*
+ * QEMU loads this shim with -kernel and mach_kernel as the first multiboot module (-initrd). The shim loads the
+ * Mach-O segments, builds MACH_BOOTARGS like boot.efi (command line, framebuffer, EFI memory map, EFI system table
+ * with the ACPI RSDP) and enters mach_kernel at its LC_UNIXTHREAD EIP with the boot args pointer in EAX.
+ *
+ *   qemu-system-i386 -m 512 -vga std -serial stdio -kernel shim.elf -initrd mach_kernel -append "<cmdline>"
+ *
+ * The framebuffer is the Bochs/QEMU standard VGA (-vga std) switched to SHIM_SCREEN_WIDTH x SHIM_SCREEN_HEIGHT.
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002
+#define MULTIBOOT_INFO_CMDLINE      (1 << 2)
+#define MULTIBOOT_INFO_MODS         (1 << 3)
+#define MULTIBOOT_INFO_MMAP         (1 << 6)
+
+#define MULTIBOOT_MEMORY_AVAILABLE  1
+#define MULTIBOOT_MEMORY_ACPI       3
+#define MULTIBOOT_MEMORY_NVS        4
+#define MULTIBOOT_MEMORY_BADRAM     5
+
+#define MACHO_LC_UNIXTHREAD         0x5
+#define MACHO_I386_THREAD_STATE     1
+#define MACHO_I386_STATE_EIP        10
+
+#define SHIM_SCREEN_WIDTH           1280
+#define SHIM_SCREEN_HEIGHT          720
+#define SHIM_DESCRIPTOR_SIZE        48 /* What Apple's firmware uses */
+#define SHIM_MAX_DESCRIPTORS        64
+
+#define DISPI_INDEX                 0x1CE
+#define DISPI_DATA                  0x1CF
+#define DISPI_ID                    0
+#define DISPI_XRES                  1
+#define DISPI_YRES                  2
+#define DISPI_BPP                   3
+#define DISPI_ENABLE                4
+#define DISPI_ENABLED               0x01
+#define DISPI_LFB_ENABLED           0x40
+#define BOCHS_VGA_ID                0x11111234 /* Device 0x1111, vendor 0x1234 */
+
+typedef struct {
+    u32 Flags;
+    u32 MemoryLower;
+    u32 MemoryUpper;
+    u32 BootDevice;
+    u32 CmdLine;
+    u32 ModuleCount;
+    u32 ModuleAddress;
+    u32 Symbols[4];
+    u32 MmapLength;
+    u32 MmapAddress;
+} MULTIBOOT_INFO, *PMULTIBOOT_INFO;
+
+typedef struct {
+    u32 Start;
+    u32 End;
+    u32 String;
+    u32 Reserved;
+} MULTIBOOT_MODULE, *PMULTIBOOT_MODULE;
+
+typedef struct {
+    u32 Size; /* Size of the rest of the entry */
+    u64 Address;
+    u64 Length;
+    u32 Type;
+} __attribute__((packed)) MULTIBOOT_MMAP_ENTRY, *PMULTIBOOT_MMAP_ENTRY;
+
+typedef struct {
+    u64 Start;
+    u64 End;
+    u32 Type;
+} SHIM_RANGE, *PSHIM_RANGE;
+
+extern char __shim_start[];
+extern void ShimStartMachO(u32 Entry, PMACH_BOOTARGS Args);
+
+static MACH_BOOTARGS ShimBootArgs;
+static u8 ShimMemoryMap[SHIM_MAX_DESCRIPTORS * SHIM_DESCRIPTOR_SIZE] __attribute__((aligned(8)));
+static u32 ShimMemoryMapSize;
+static efi_system_table_t ShimSystemTable;
+static efi_config_table_t ShimConfigTables[2];
+
+/* Memory that must not be handed out as conventional memory: mach_kernel's segments, the shim and its modules */
+static SHIM_RANGE ShimInUse[2];
+
+/* FUNCTIONS ******************************************************************/
+
+/* gcc may call these for structure copies */
+void *memcpy(void *to, const void *from, size_t n) {
+    u8 *d = to;
+    const u8 *s = from;
+
+    while (n--) {
+        *d++ = *s++;
+    }
+    return to;
+}
+
+void *memset(void *s, int c, size_t count) {
+    u8 *d = s;
+
+    while (count--) {
+        *d++ = (u8) c;
+    }
+    return s;
+}
+
+static inline
+void ShimOutb(u16 Port, u8 Value) {
+    __asm__ __volatile__ ("outb %0, %1" : : "a" (Value), "Nd" (Port));
+}
+
+static inline
+u8 ShimInb(u16 Port) {
+    u8 Value;
+
+    __asm__ __volatile__ ("inb %1, %0" : "=a" (Value) : "Nd" (Port));
+    return Value;
+}
+
+static inline
+void ShimOutw(u16 Port, u16 Value) {
+    __asm__ __volatile__ ("outw %0, %1" : : "a" (Value), "Nd" (Port));
+}
+
+static inline
+u16 ShimInw(u16 Port) {
+    u16 Value;
+
+    __asm__ __volatile__ ("inw %1, %0" : "=a" (Value) : "Nd" (Port));
+    return Value;
+}
+
+static inline
+void ShimOutl(u16 Port, u32 Value) {
+    __asm__ __volatile__ ("outl %0, %1" : : "a" (Value), "Nd" (Port));
+}
+
+static inline
+u32 ShimInl(u16 Port) {
+    u32 Value;
+
+    __asm__ __volatile__ ("inl %1, %0" : "=a" (Value) : "Nd" (Port));
+    return Value;
+}
+
+static
+void ShimPrint(const char *String) {
+    for (; *String != '\0'; String++) {
+        while (!(ShimInb(COM1 + 5) & 0x20)) {
+            /* Wait for the transmitter */
+        }
+        ShimOutb(COM1, *String);
+    }
+}
+
+static
+void ShimPrintHex(u32 Value) {
+    char Buffer[11] = "0x";
+
+    for (int i = 0; i < 8; i++) {
+        Buffer[2 + i] = "0123456789ABCDEF"[(Value >> (28 - 4 * i)) & 0xF];
+    }
+    Buffer[10] = '\0';
+    ShimPrint(Buffer);
+}
+
+static
+void ShimFail(const char *Message) {
+    ShimPrint("atvshim: ");
+    ShimPrint(Message);
+    ShimPrint("\n");
+    for (;;) {
+        __asm__ __volatile__ ("cli; hlt");
+    }
+}
+
+/* Load the segments of a Mach-O executable and return its entry point */
+static
+u32 ShimLoadMachO(u8 *Image, u32 Length, u32 ShimStart) {
+    PMACHO_HEADER Header = (PMACHO_HEADER) Image;
+    u8 *Command = Image + sizeof(MACHO_HEADER);
+    u32 Entry = 0;
+
+    if (Length < sizeof(MACHO_HEADER) || Header->MagicNumber != MACHO_MAGIC) {
+        ShimFail("module is not a 32-bit Mach-O image");
+    }
+    ShimInUse[0].Start = 0xFFFFFFFF;
+    ShimInUse[0].Type = EFI_LOADER_CODE;
+
+    for (u32 i = 0; i < Header->NumberOfCmds; i++) {
+        PMACHO_SEGMENT_COMMAND Segment = (PMACHO_SEGMENT_COMMAND) Command;
+
+        if (Segment->Command == MACHO_LC_SEGMENT && Segment->VMAddress != 0 && Segment->VMSize != 0) {
+            if (Segment->FileOffset + Segment->FileSize > Length || Segment->FileSize > Segment->VMSize) {
+                ShimFail("segment is outside the image");
+            }
+            if (Segment->VMAddress + Segment->VMSize > ShimStart) {
+                ShimFail("segment overlaps the shim, link mach_kernel lower or the shim higher");
+            }
+            memcpy((void *) Segment->VMAddress, Image + Segment->FileOffset, Segment->FileSize);
+            memset((u8 *) Segment->VMAddress + Segment->FileSize, 0, Segment->VMSize - Segment->FileSize);
+
+            if (Segment->VMAddress < ShimInUse[0].Start) {
+                ShimInUse[0].Start = Segment->VMAddress;
+            }
+            if (Segment->VMAddress + Segment->VMSize > ShimInUse[0].End) {
+                ShimInUse[0].End = Segment->VMAddress + Segment->VMSize;
+            }
+        } else if (Segment->Command == MACHO_LC_UNIXTHREAD) {
+            u32 *Thread = (u32 *) (Command + 8);
+
+            /* flavor, count, then the i386 thread state */
+            if (Thread[0] == MACHO_I386_THREAD_STATE && Thread[1] > MACHO_I386_STATE_EIP) {
+                Entry = Thread[2 + MACHO_I386_STATE_EIP];
+            }
+        }
+        Command += Segment->CommandSize;
+    }
+
+    if (Entry == 0) {
+        ShimFail("no LC_UNIXTHREAD entry point");
+    }
+    return Entry;
+}
+
+static
+void ShimAddDescriptor(u32 Type, u64 Start, u64 End) {
+    efi_memory_desc_t *Descriptor = (efi_memory_desc_t *) (ShimMemoryMap + ShimMemoryMapSize);
+
+    if (End <= Start) {
+        return;
+    }
+    if (ShimMemoryMapSize == sizeof(ShimMemoryMap)) {
+        ShimFail("too many memory map entries");
+    }
+    memset(Descriptor, 0, SHIM_DESCRIPTOR_SIZE);
+    Descriptor->type = Type;
+    Descriptor->phys_addr = Start;
+    Descriptor->num_pages = (End - Start) >> EFI_PAGE_SHIFT;
+    Descriptor->attribute = (Type == EFI_CONVENTIONAL_MEMORY || Type == EFI_LOADER_CODE ||
+                             Type == EFI_LOADER_DATA) ? EFI_MEMORY_WB : 0;
+    ShimMemoryMapSize += SHIM_DESCRIPTOR_SIZE;
+}
+
+/* Usable RAM becomes conventional memory except where mach_kernel or the shim are */
+static
+void ShimAddRam(u64 Start, u64 End) {
+    u64 Cursor = PAGE_ALIGN(Start);
+
+    End &= ~(u64) (PAGE_SIZE - 1);
+    for (u32 i = 0; i < sizeof(ShimInUse) / sizeof(ShimInUse[0]); i++) {
+        u64 InUseStart = ShimInUse[i].Start & ~(u64) (PAGE_SIZE - 1);
+        u64 InUseEnd = PAGE_ALIGN(ShimInUse[i].End);
+
+        if (InUseEnd <= Cursor || InUseStart >= End) {
+            continue;
+        }
+        if (InUseStart > Cursor) {
+            ShimAddDescriptor(EFI_CONVENTIONAL_MEMORY, Cursor, InUseStart);
+            Cursor = InUseStart;
+        }
+        ShimAddDescriptor(ShimInUse[i].Type, Cursor, InUseEnd < End ? InUseEnd : End);
+        Cursor = InUseEnd < End ? InUseEnd : End;
+    }
+    ShimAddDescriptor(EFI_CONVENTIONAL_MEMORY, Cursor, End);
+}
+
+/* Convert the multiboot memory map (E820) into an EFI memory map */
+static
+void ShimSetupMemoryMap(PMULTIBOOT_INFO Info) {
+    u8 *Entry = (u8 *) Info->MmapAddress;
+    u8 *End = Entry + Info->MmapLength;
+
+    if (!(Info->Flags & MULTIBOOT_INFO_MMAP)) {
+        ShimFail("no memory map from the boot loader");
+    }
+    /* ShimInUse is sorted: mach_kernel's segments are below the shim */
+    for (; Entry < End; Entry += ((PMULTIBOOT_MMAP_ENTRY) Entry)->Size + sizeof(u32)) {
+        PMULTIBOOT_MMAP_ENTRY Range = (PMULTIBOOT_MMAP_ENTRY) Entry;
+        u64 Start = Range->Address & ~(u64) (PAGE_SIZE - 1);
+        u64 Limit = PAGE_ALIGN(Range->Address + Range->Length);
+
+        switch (Range->Type) {
+            case MULTIBOOT_MEMORY_AVAILABLE:
+                ShimAddRam(Range->Address, Range->Address + Range->Length);
+                break;
+            case MULTIBOOT_MEMORY_ACPI:
+                ShimAddDescriptor(EFI_ACPI_RECLAIM_MEMORY, Start, Limit);
+                break;
+            case MULTIBOOT_MEMORY_NVS:
+                ShimAddDescriptor(EFI_ACPI_MEMORY_NVS, Start, Limit);
+                break;
+            case MULTIBOOT_MEMORY_BADRAM:
+                ShimAddDescriptor(EFI_UNUSABLE_MEMORY, Start, Limit);
+                break;
+            default:
+                ShimAddDescriptor(EFI_RESERVED_TYPE, Start, Limit);
+                break;
+        }
+    }
+
+    ShimBootArgs.EfiMemoryMap = (u32) ShimMemoryMap;
+    ShimBootArgs.EfiMemoryMapSize = ShimMemoryMapSize;
+    ShimBootArgs.EfiMemoryDescriptorSize = SHIM_DESCRIPTOR_SIZE;
+    ShimBootArgs.EfiMemoryDescriptorVersion = EFI_MEMORY_DESCRIPTOR_VERSION;
+}
+
+static
+acpi_rsdp_t *ShimScanRsdp(u32 Start, u32 End) {
+    for (u32 Address = Start; Address + 20 <= End; Address += 16) {
+        const u8 *Candidate = (const u8 *) Address;
+        u8 Sum = 0;
+
+        if (*(const u32 *) Candidate != ACPI_RSDP1_SIG || *(const u32 *) (Candidate + 4) != ACPI_RSDP2_SIG) {
+            continue;
+        }
+        for (int i = 0; i < 20; i++) {
+            Sum += Candidate[i];
+        }
+        if (Sum == 0) {
+            return (acpi_rsdp_t *) Address;
+        }
+    }
+    return NULL;
+}
+
+/* Find the RSDP the way Linux does on legacy systems and hand it over in an EFI system table */
+static
+void ShimSetupSystemTable() {
+    acpi_rsdp_t *Rsdp = NULL;
+    u32 Tables = 0;
+    u16 EbdaSegment;
+
+    /* The BIOS data area holds the segment of the extended BIOS data area; read it with asm, compilers object to
+     * dereferencing addresses in the first page */
+    __asm__ __volatile__ ("movw (%1), %0" : "=r" (EbdaSegment) : "r" (0x40E));
+    u32 Ebda = (u32) EbdaSegment << 4;
+
+    if (Ebda >= 0x80000 && Ebda < ACPI_BIOS_ROM_BASE) {
+        Rsdp = ShimScanRsdp(Ebda, Ebda + 0x400);
+    }
+    if (!Rsdp) {
+        Rsdp = ShimScanRsdp(ACPI_BIOS_ROM_BASE, ACPI_BIOS_ROM_END);
+    }
+    if (!Rsdp) {
+        ShimFail("no ACPI RSDP found");
+    }
+
+    if (Rsdp->revision >= 2) {
+        ShimConfigTables[Tables].guid = ACPI_20_TABLE_GUID;
+        ShimConfigTables[Tables++].table = (unsigned long) Rsdp;
+    }
+    ShimConfigTables[Tables].guid = ACPI_TABLE_GUID;
+    ShimConfigTables[Tables++].table = (unsigned long) Rsdp;
+
+    ShimSystemTable.hdr.signature = 0x5453595320494249ULL; /* "IBI SYST" */
+    ShimSystemTable.hdr.revision = (1 << 16) | 10;
+    ShimSystemTable.hdr.headersize = sizeof(efi_system_table_t);
+    ShimSystemTable.nr_tables = Tables;
+    ShimSystemTable.tables = (unsigned long) ShimConfigTables;
+
+    ShimBootArgs.EfiSystemTable = (u32) &ShimSystemTable;
+    ShimBootArgs.EfiMode = 32;
+}
+
+static
+u32 ShimPciRead32(u32 Device, u8 Offset) {
+    ShimOutl(PCI_CONFIG_ADDRESS, 0x80000000 | (Device << 11) | (Offset & 0xFC));
+    return ShimInl(PCI_CONFIG_DATA);
+}
+
+static
+void ShimDispiWrite(u16 Index, u16 Value) {
+    ShimOutw(DISPI_INDEX, Index);
+    ShimOutw(DISPI_DATA, Value);
+}
+
+/* Switch the QEMU standard VGA to a 32-bit linear framebuffer, like the one boot.efi leaves behind */
+static
+void ShimSetupVideo() {
+    u32 Framebuffer = 0;
+    u16 Id;
+
+    ShimOutw(DISPI_INDEX, DISPI_ID);
+    Id = ShimInw(DISPI_DATA);
+    if (Id < 0xB0C0 || Id > 0xB0CF) {
+        ShimFail("no Bochs VBE display, run QEMU with -vga std");
+    }
+    for (u32 Device = 0; Device < 32; Device++) {
+        if (ShimPciRead32(Device, PCI_VENDOR_ID) == BOCHS_VGA_ID) {
+            Framebuffer = ShimPciRead32(Device, PCI_BAR0) & ~0xFU;
+            break;
+        }
+    }
+    if (Framebuffer == 0) {
+        ShimFail("no framebuffer BAR on the standard VGA");
+    }
+
+    ShimDispiWrite(DISPI_ENABLE, 0);
+    ShimDispiWrite(DISPI_XRES, SHIM_SCREEN_WIDTH);
+    ShimDispiWrite(DISPI_YRES, SHIM_SCREEN_HEIGHT);
+    ShimDispiWrite(DISPI_BPP, 32);
+    ShimDispiWrite(DISPI_ENABLE, DISPI_ENABLED | DISPI_LFB_ENABLED);
+
+    ShimBootArgs.Video.BaseAddress = Framebuffer;
+    ShimBootArgs.Video.DisplayMode = 1; /* Graphics */
+    ShimBootArgs.Video.Pitch = SHIM_SCREEN_WIDTH * 4;
+    ShimBootArgs.Video.Width = SHIM_SCREEN_WIDTH;
+    ShimBootArgs.Video.Height = SHIM_SCREEN_HEIGHT;
+    ShimBootArgs.Video.Depth = 32;
+}
+
+/* Multiboot boot loaders pass the shim's own path first, the rest is for the loader and Linux */
+static
+void ShimSetupCmdline(PMULTIBOOT_INFO Info) {
+    const char *CmdLine = "";
+    u32 i;
+
+    if (Info->Flags & MULTIBOOT_INFO_CMDLINE) {
+        CmdLine = (const char *) Info->CmdLine;
+        while (*CmdLine != '\0' && *CmdLine != ' ') {
+            CmdLine++;
+        }
+        while (*CmdLine == ' ') {
+            CmdLine++;
+        }
+    }
+    for (i = 0; i < MACH_CMDLINE - 1 && CmdLine[i] != '\0'; i++) {
+        ShimBootArgs.CmdLine[i] = CmdLine[i];
+    }
+    ShimBootArgs.CmdLine[i] = '\0';
+}
+
+void ShimMain(u32 Magic, PMULTIBOOT_INFO Info) {
+    PMULTIBOOT_MODULE Module;
+    u32 Entry;
+
+    ShimPrint("atvshim: starting\n");
+    if (Magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+        ShimFail("not started by a multiboot boot loader");
+    }
+    if (!(Info->Flags & MULTIBOOT_INFO_MODS) || Info->ModuleCount == 0) {
+        ShimFail("mach_kernel must be passed as the first module (QEMU: -initrd mach_kernel)");
+    }
+    Module = (PMULTIBOOT_MODULE) Info->ModuleAddress;
+
+    /* The shim and everything the boot loader put behind it (modules, command lines) stay in use */
+    ShimInUse[1].Start = (u32) __shim_start;
+    ShimInUse[1].End = Module[Info->ModuleCount - 1].End;
+    ShimInUse[1].Type = EFI_LOADER_DATA;
+
+    Entry = ShimLoadMachO((u8 *) Module[0].Start, Module[0].End - Module[0].Start, (u32) __shim_start);
+
+    ShimBootArgs.Revision = 4;
+    ShimBootArgs.Version = 1;
+    ShimBootArgs.KernelBaseAddress = ShimInUse[0].Start;
+    ShimBootArgs.KernelSize = ShimInUse[0].End - ShimInUse[0].Start;
+    ShimSetupCmdline(Info);
+    ShimSetupVideo();
+    ShimSetupMemoryMap(Info);
+    ShimSetupSystemTable();
+
+    ShimPrint("atvshim: entering mach_kernel at ");
+    ShimPrintHex(Entry);
+    ShimPrint(", boot args at ");
+    ShimPrintHex((u32) &ShimBootArgs);
+    ShimPrint("\n");
+    ShimStartMachO(Entry, &ShimBootArgs);
+}
@@ -0,0 +1,58 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Boot timeline (per-phase TSC timestamps) for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+static TIMELINE_MARK TimelineMarks[TIMELINE_MAX_MARKS];
+static u32 TimelineCount;
+
+/* FUNCTIONS ******************************************************************/
+
+static inline
+u64 ReadTsc() {
+    u32 Low, High;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (Low), "=d" (High));
+    return ((u64) High << 32) | Low;
+}
+
+/* Record the end of a loader phase. The first mark is the reference point for all others. */
+void TimelineMark(const char *Name) {
+    if (TimelineCount == TIMELINE_MAX_MARKS) {
+        return;
+    }
+    TimelineMarks[TimelineCount].Name = Name;
+    TimelineMarks[TimelineCount].Timestamp = ReadTsc();
+    TimelineCount++;
+}
+
+/*
+ * Format the timeline as "<phase> <kcycles since first mark> <kcycles in phase>" lines, which is also how it is
+ * printed to the serial port. Returns the length written.
+ */
+u32 TimelineFormat(char *Buffer, u32 Size) {
+    char Line[80];
+    u32 Length = 0;
+
+    for (u32 i = 0; i < TimelineCount; i++) {
+        u64 Total = TimelineMarks[i].Timestamp - TimelineMarks[0].Timestamp;
+        u64 Phase = i ? TimelineMarks[i].Timestamp - TimelineMarks[i - 1].Timestamp : 0;
+        u32 LineLength = sprintf(Line, "%s %u %u\n", TimelineMarks[i].Name, lo32(Total >> 10), lo32(Phase >> 10));
+
+        if (Length + LineLength >= Size) {
+            break;
+        }
+        memcpy(Buffer + Length, Line, LineLength);
+        Length += LineLength;
+    }
+    Buffer[Length] = '\0';
+    return Length;
+}
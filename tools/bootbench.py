@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+#
+# PROJECT:		FreeLoader wrapper for Apple TV
+# LICENSE:		MIT (https://spdx.org/licenses/MIT)
+# PURPOSE:		Boot mach_kernel under QEMU several times and report per-phase boot time medians
+# COPYRIGHT:	Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+#
+# Each run boots the multiboot shim (multiboot/shim.c), which starts mach_kernel the way boot.efi does, and reads
+# the serial port until the kernel reaches user space. Three clocks are collected:
+#
+#   host.*      wall clock milliseconds from starting QEMU to the first serial line of the shim, the loader and the
+#               kernel, and to the end of the run
+#   loader.*    the loader's boot timeline, kcycles per phase as printed before the jump to Linux
+#   kernel.*    printk timestamps (printk.time=1) of kernel milestones, in milliseconds
+#
+#   bootbench.py mach_kernel --shim multiboot/shim.elf --runs 10 --append "console=ttyS0 printk.time=1"
+#
+# Runs that time out or never print the loader timeline are reported and left out of the medians.
+#
+
+import argparse
+import os
+import re
+import selectors
+import statistics
+import subprocess
+import sys
+import time
+
+TIMELINE_HEADER = 'Boot timeline (phase, kcycles total, kcycles in phase):'
+TIMELINE_LINE = re.compile(r'^(\S+) (\d+) (\d+)$')
+PRINTK_LINE = re.compile(r'^\[\s*(\d+\.\d+)\] (.*)$')
+SHIM_START = 'atvshim: starting'
+SHIM_HANDOFF = 'atvshim: entering mach_kernel'
+
+# kernel milestones: (metric, pattern of the printk message)
+KERNEL_MILESTONES = (
+    ('kernel.initrd-unpacked', re.compile(r'Freeing initrd memory')),
+    ('kernel.init-freed', re.compile(r'Freeing unused kernel')),
+    ('kernel.userspace', re.compile(r'Run \S+ as init process')),
+)
+DEFAULT_UNTIL = r'Run \S+ as init process|Kernel panic'
+
+
+class Run:
+    def __init__(self):
+        self.metrics = {}
+        self.timeline = False
+        self.lines = []
+        self.error = None
+
+
+def qemu_command(args):
+    command = [args.qemu, '-m', str(args.memory), '-vga', 'std', '-display', 'none', '-monitor', 'none',
+               '-serial', 'stdio', '-no-reboot', '-kernel', args.shim, '-initrd', args.mach_kernel,
+               '-append', args.append]
+    if args.kvm:
+        command += ['-enable-kvm', '-cpu', 'host']
+    return command + args.qemu_arg
+
+
+def parse_line(run, line, elapsed, state):
+    """Update run with one serial line received elapsed milliseconds after QEMU was started."""
+    metrics = run.metrics
+    if SHIM_START in line:
+        metrics.setdefault('host.shim', elapsed)
+    elif SHIM_HANDOFF in line:
+        metrics.setdefault('host.loader', elapsed)
+    elif line.startswith(TIMELINE_HEADER):
+        state['timeline'] = True
+        run.timeline = True
+        return
+    elif state.get('timeline'):
+        match = TIMELINE_LINE.match(line)
+        if match:
+            metrics['loader.' + match.group(1)] = int(match.group(3))
+            metrics['loader.total'] = int(match.group(2))
+            return
+        state['timeline'] = False
+
+    match = PRINTK_LINE.match(line)
+    if match:
+        metrics.setdefault('host.kernel', elapsed)
+        stamp = float(match.group(1)) * 1000
+        for name, pattern in KERNEL_MILESTONES:
+            if name not in metrics and pattern.search(match.group(2)):
+                metrics[name] = stamp
+
+
+def boot_once(args, until):
+    run = Run()
+    state = {}
+    started = time.monotonic()
+    qemu = subprocess.Popen(qemu_command(args), stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE)
+    selector = selectors.DefaultSelector()
+    selector.register(qemu.stdout, selectors.EVENT_READ)
+    pending = b''
+
+    try:
+        while True:
+            remaining = args.timeout - (time.monotonic() - started)
+            if remaining <= 0:
+                run.error = 'timed out after %d s' % args.timeout
+                break
+            if not selector.select(remaining):
+                continue
+            data = os.read(qemu.stdout.fileno(), 65536)
+            if not data:
+                run.error = 'QEMU exited: %s' % qemu.stderr.read().decode(errors='replace').strip()
+                break
+            elapsed = (time.monotonic() - started) * 1000
+            pending += data
+            *lines, pending = pending.split(b'\n')
+            done = False
+            for raw in lines:
+                line = raw.decode(errors='replace').rstrip('\r')
+                run.lines.append(line)
+                parse_line(run, line, elapsed, state)
+                if until.search(line):
+                    run.metrics['host.done'] = elapsed
+                    done = True
+            if done:
+                break
+    finally:
+        selector.close()
+        qemu.kill()
+        qemu.wait()
+
+    if not run.error and not run.timeline:
+        run.error = 'no loader timeline on the serial port'
+    return run
+
+
+def report(runs):
+    names = []
+    for run in runs:
+        for name in run.metrics:
+            if name not in names:
+                names.append(name)
+    # host clock, then loader phases in boot order and their total, then kernel milestones
+    names.sort(key=lambda name: (('host', 'loader', 'kernel').index(name.split('.')[0]), name == 'loader.total'))
+
+    print('%-26s %8s %12s %12s %12s %4s' % ('phase', 'unit', 'median', 'min', 'max', 'n'))
+    for name in names:
+        values = [run.metrics[name] for run in runs if name in run.metrics]
+        unit = 'kcycles' if name.startswith('loader.') else 'ms'
+        print('%-26s %8s %12.1f %12.1f %12.1f %4d' % (name, unit, statistics.median(values), min(values),
+                                                     max(values), len(values)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Boot mach_kernel under QEMU and report per-phase medians.')
+    parser.add_argument('mach_kernel', help='mach_kernel with the kernel and initrd to boot')
+    parser.add_argument('--shim', default='multiboot/shim.elf', help='multiboot shim (make multiboot/shim.elf)')
+    parser.add_argument('-n', '--runs', type=int, default=10, help='number of boots')
+    parser.add_argument('--append', default='console=ttyS0,115200n8 printk.time=1',
+                        help='command line for the loader and Linux')
+    parser.add_argument('--until', default=DEFAULT_UNTIL, help='serial output (regex) that ends a run')
+    parser.add_argument('--timeout', type=int, default=120, help='seconds before a run is abandoned')
+    parser.add_argument('--qemu', default='qemu-system-i386', help='QEMU binary')
+    parser.add_argument('--memory', type=int, default=512, help='guest memory in MB, the shim sits at 128MB')
+    parser.add_argument('--kvm', action='store_true', help='use KVM, closer to real hardware timings')
+    parser.add_argument('--qemu-arg', action='append', default=[], help='extra QEMU argument (repeatable)')
+    parser.add_argument('--log-dir', help='keep the serial output of every run here')
+    args = parser.parse_args()
+
+    if args.memory < 256:
+        parser.error('the shim is linked at 128MB and needs mach_kernel behind it, use --memory 256 or more')
+    until = re.compile(args.until)
+    if args.log_dir:
+        os.makedirs(args.log_dir, exist_ok=True)
+
+    runs = []
+    for number in range(1, args.runs + 1):
+        run = boot_once(args, until)
+        if args.log_dir:
+            with open(os.path.join(args.log_dir, 'run%03d.log' % number), 'w') as log:
+                log.write('\n'.join(run.lines) + '\n')
+        if run.error:
+            print('run %d: %s' % (number, run.error), file=sys.stderr)
+            continue
+        print('run %d: %.0f ms' % (number, run.metrics.get('host.done', 0)), file=sys.stderr)
+        runs.append(run)
+
+    if not runs:
+        sys.exit('no successful runs')
+    report(runs)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+#
+# PROJECT:		FreeLoader wrapper for Apple TV
+# LICENSE:		MIT (https://spdx.org/licenses/MIT)
+# PURPOSE:		Replace the kernel and initrd of a linked mach_kernel without relinking
+# COPYRIGHT:	Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+#
+# The Makefile links the kernel, initrd and initramfs reserve into __PAYLOAD, the last segment before __LINKEDIT, so
+# resizing them never moves any loader code or data. This tool lays out the payload sections again at their
+# alignment, moves __LINKEDIT (symbol table) behind them and patches the load commands.
+#
+#   machopack.py mach_kernel --kernel bzImage --initrd initrd.img            repack mach_kernel in place
+#   machopack.py mach_kernel -o out --kernel bzImage --initrd initrd.img     write a repacked copy to out
+#   machopack.py mach_kernel --batch variants.txt --jobs 8                   write many copies in parallel
+#
+# Each line of a batch file is "<output> [kernel=<path>] [initrd=<path>] [<section>=<path> ...]"; empty lines and
+# lines starting with # are ignored. Payload data is copied straight into a memory mapping of the output, and in
+# place only the load commands, the payload and __LINKEDIT are touched.
+#
+
+import argparse
+import mmap
+import os
+import shlex
+import struct
+import sys
+from concurrent.futures import ProcessPoolExecutor
+
+MACHO_MAGIC = 0xFEEDFACE
+MACHO_LC_SEGMENT = 0x1
+MACHO_LC_SYMTAB = 0x2
+MACHO_LC_DYSYMTAB = 0xB
+MACHO_SECTION_TYPE = 0xFF
+MACHO_ZEROFILL = 0x1
+
+PAYLOAD_SEGMENT = '__PAYLOAD'
+LINKEDIT_SEGMENT = '__LINKEDIT'
+PAGE_SIZE = 0x1000
+COPY_CHUNK = 0x400000
+ALIASES = {'kernel': '__vmlinuz', 'initrd': '__initrd'}
+
+HEADER = struct.Struct('<7I')  # magic, cputype, cpusubtype, filetype, ncmds, sizeofcmds, flags
+COMMAND = struct.Struct('<2I')  # cmd, cmdsize
+SEGMENT = struct.Struct('<2I16s8I')  # cmd, cmdsize, segname, vmaddr, vmsize, fileoff, filesize, ..., nsects, flags
+SECTION = struct.Struct('<16s16s9I')  # sectname, segname, addr, size, offset, align, reloff, nreloc, flags, ...
+SYMTAB_OFFSETS = (8, 16)  # symoff, stroff
+DYSYMTAB_OFFSETS = (32, 40, 48, 56, 64, 72)  # tocoff, modtaboff, extrefsymoff, indirectsymoff, extreloff, locreloff
+
+# field indices
+SEG_NAME, SEG_VMADDR, SEG_VMSIZE, SEG_FILEOFF, SEG_FILESIZE, SEG_NSECTS = 2, 3, 4, 5, 6, 9
+SECT_NAME, SECT_ADDR, SECT_SIZE, SECT_OFFSET, SECT_ALIGN, SECT_FLAGS = 0, 2, 3, 4, 5, 8
+
+
+class PackError(Exception):
+    pass
+
+
+def align(value, alignment):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+
+def cstring(raw):
+    return raw.split(b'\0', 1)[0].decode()
+
+
+class Image:
+    """Load commands of a 32-bit Mach-O executable, edited in memory and written back with commands()."""
+
+    def __init__(self, f):
+        f.seek(0)
+        header = f.read(HEADER.size)
+        if len(header) < HEADER.size or HEADER.unpack(header)[0] != MACHO_MAGIC:
+            raise PackError('not a 32-bit little-endian Mach-O image')
+        ncmds, sizeofcmds = HEADER.unpack(header)[4:6]
+        self.data = bytearray(header + f.read(sizeofcmds))
+        self.segments = []  # [offset, fields, [[offset, fields], ...]]
+        self.symtab = self.dysymtab = None
+
+        offset = HEADER.size
+        for _ in range(ncmds):
+            cmd, cmdsize = COMMAND.unpack_from(self.data, offset)
+            if cmd == MACHO_LC_SEGMENT:
+                segment = list(SEGMENT.unpack_from(self.data, offset))
+                sections = []
+                for i in range(segment[SEG_NSECTS]):
+                    at = offset + SEGMENT.size + i * SECTION.size
+                    sections.append([at, list(SECTION.unpack_from(self.data, at))])
+                self.segments.append([offset, segment, sections])
+            elif cmd == MACHO_LC_SYMTAB:
+                self.symtab = offset
+            elif cmd == MACHO_LC_DYSYMTAB:
+                self.dysymtab = offset
+            offset += cmdsize
+
+    def segment(self, name):
+        for segment in self.segments:
+            if cstring(segment[1][SEG_NAME]) == name:
+                return segment
+        raise PackError('no %s segment, was the image linked with the current Makefile?' % name)
+
+    def commands(self):
+        for offset, segment, sections in self.segments:
+            SEGMENT.pack_into(self.data, offset, *segment)
+            for at, section in sections:
+                SECTION.pack_into(self.data, at, *section)
+        return bytes(self.data)
+
+
+def plan(image, file_size, sizes):
+    """
+    Lay out the payload sections with the given sizes. Returns the sections as (name, old offset, new offset, old size,
+    new size) plus the old and new start of the data behind the payload, and updates the load commands of image to match.
+    """
+    _, payload, sections = image.segment(PAYLOAD_SEGMENT)
+    later = [s for s in image.segments if s[1][SEG_FILEOFF] > payload[SEG_FILEOFF] or
+             s[1][SEG_VMADDR] > payload[SEG_VMADDR]]
+    # the loader is not relocatable: only the symbol table may move, loader code or data behind the payload may not
+    moved = [cstring(s[1][SEG_NAME]) for s in later if cstring(s[1][SEG_NAME]) != LINKEDIT_SEGMENT]
+    if moved:
+        raise PackError('%s follows %s and cannot be moved, was the image linked with the current Makefile?' %
+                        (', '.join(moved), PAYLOAD_SEGMENT))
+    tail_start = min([s[1][SEG_FILEOFF] for s in later] + [file_size])
+
+    layout, address = [], payload[SEG_VMADDR]
+    for _, section in sections:
+        name = cstring(section[SECT_NAME])
+        if section[SECT_FLAGS] & MACHO_SECTION_TYPE == MACHO_ZEROFILL:
+            raise PackError('%s,%s is zero fill' % (PAYLOAD_SEGMENT, name))
+        address = align(address, 1 << section[SECT_ALIGN])
+        size = sizes.get(name, section[SECT_SIZE])
+        offset = payload[SEG_FILEOFF] + address - payload[SEG_VMADDR]
+        layout.append((name, section[SECT_OFFSET], offset, section[SECT_SIZE], size))
+        section[SECT_ADDR], section[SECT_SIZE], section[SECT_OFFSET] = address, size, offset
+        address += size
+
+    unknown = set(sizes) - set(entry[0] for entry in layout)
+    if unknown:
+        raise PackError('no %s section %s' % (PAYLOAD_SEGMENT, ', '.join(sorted(unknown))))
+
+    vmsize = align(address - payload[SEG_VMADDR], PAGE_SIZE)
+    file_delta = payload[SEG_FILEOFF] + vmsize - tail_start if later else 0
+    vm_delta = vmsize - payload[SEG_VMSIZE]
+    payload[SEG_VMSIZE] = vmsize
+    payload[SEG_FILESIZE] = vmsize if later else address - payload[SEG_VMADDR]
+
+    # __LINKEDIT moves along with the payload
+    for _, segment, sections in later:
+        segment[SEG_VMADDR] += vm_delta
+        segment[SEG_FILEOFF] += file_delta
+        for _, section in sections:
+            section[SECT_ADDR] += vm_delta
+            if section[SECT_OFFSET]:
+                section[SECT_OFFSET] += file_delta
+    for command, fields in ((image.symtab, SYMTAB_OFFSETS), (image.dysymtab, DYSYMTAB_OFFSETS)):
+        if command is None:
+            continue
+        for field in fields:
+            value = struct.unpack_from('<I', image.data, command + field)[0]
+            if value >= tail_start:
+                struct.pack_into('<I', image.data, command + field, value + file_delta)
+
+    return layout, tail_start, payload[SEG_FILEOFF] + payload[SEG_FILESIZE]
+
+
+def copy_into(view, source, offset, size):
+    """Read size bytes from source straight into the mapped output."""
+    done = 0
+    while done < size:
+        read = source.readinto(view[offset + done:offset + min(size, done + COPY_CHUNK)])
+        if not read:
+            raise PackError('%s is shorter than expected' % source.name)
+        done += read
+
+
+def pack(template, output, payloads):
+    """Write template with its payload sections replaced by the files in payloads to output (None: in place)."""
+    sizes = {name: os.path.getsize(path) for name, path in payloads.items()}
+    in_place = output is None or os.path.realpath(output) == os.path.realpath(template)
+
+    with open(template, 'r+b' if in_place else 'rb') as source:
+        source_size = os.fstat(source.fileno()).st_size
+        image = Image(source)
+        payload_start = image.segment(PAYLOAD_SEGMENT)[1][SEG_FILEOFF]
+        layout, tail_start, new_tail_start = plan(image, source_size, sizes)
+        new_size = new_tail_start + source_size - tail_start
+
+        # keep whatever is not replaced but has to move (in place) or be carried over (copy)
+        kept = []
+        for name, old_offset, offset, old_size, size in layout:
+            if name not in payloads and (offset != old_offset or not in_place):
+                source.seek(old_offset)
+                kept.append((offset, source.read(size)))
+        if new_tail_start != tail_start or not in_place:
+            source.seek(tail_start)
+            kept.append((new_tail_start, source.read()))
+
+        output_file = source if in_place else open(output, 'w+b')
+        try:
+            if not in_place:
+                source.seek(0)
+                output_file.truncate(new_size)
+            elif new_size > source_size:
+                output_file.truncate(new_size)
+
+            with mmap.mmap(output_file.fileno(), max(new_size, source_size if in_place else 0)) as mapping:
+                view = memoryview(mapping)
+                try:
+                    if not in_place:
+                        copy_into(view, source, 0, payload_start)
+                    # zero alignment padding, then fill in the sections
+                    previous = payload_start
+                    for name, _, offset, _, size in layout:
+                        view[previous:offset] = bytes(offset - previous)
+                        previous = offset + size
+                    view[previous:new_tail_start] = bytes(new_tail_start - previous)
+                    for offset, data in kept:
+                        view[offset:offset + len(data)] = data
+                    for name, _, offset, _, size in layout:
+                        if name in payloads:
+                            with open(payloads[name], 'rb') as payload:
+                                copy_into(view, payload, offset, size)
+                    commands = image.commands()
+                    view[:len(commands)] = commands
+                finally:
+                    view.release()
+
+            if new_size < source_size and in_place:
+                output_file.truncate(new_size)
+        finally:
+            if not in_place:
+                output_file.close()
+
+    return output or template
+
+
+def parse_payloads(items):
+    payloads = {}
+    for item in items:
+        name, sep, path = item.partition('=')
+        if not sep or not path:
+            raise PackError('expected <section>=<path>, got "%s"' % item)
+        payloads[ALIASES.get(name, name)] = path
+    return payloads
+
+
+def pack_variant(job):
+    template, output, payloads = job
+    try:
+        return pack(template, output, payloads), None
+    except (OSError, PackError) as error:
+        return output, str(error)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Replace the payload sections of a linked mach_kernel.')
+    parser.add_argument('template', help='mach_kernel linked by the Makefile')
+    parser.add_argument('-o', '--output', help='write a repacked copy instead of patching template in place')
+    parser.add_argument('--kernel', help='Linux kernel (bzImage) for __vmlinuz')
+    parser.add_argument('--initrd', help='initial ramdisk for __initrd')
+    parser.add_argument('--section', action='append', default=[], metavar='NAME=PATH',
+                        help='replace any other %s section' % PAYLOAD_SEGMENT)
+    parser.add_argument('--batch', help='file listing one "<output> [kernel=<path>] [initrd=<path>]" per line')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='parallel variants for --batch')
+    args = parser.parse_args()
+
+    try:
+        if args.batch:
+            jobs = []
+            with open(args.batch) as batch:
+                for line in batch:
+                    words = shlex.split(line, comments=True)
+                    if words:
+                        jobs.append((args.template, words[0], parse_payloads(words[1:])))
+            with ProcessPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+                failed = 0
+                for output, error in pool.map(pack_variant, jobs):
+                    if error:
+                        print('%s: %s' % (output, error), file=sys.stderr)
+                        failed += 1
+            if failed:
+                sys.exit('%d of %d variants failed' % (failed, len(jobs)))
+        else:
+            payloads = parse_payloads(args.section)
+            if args.kernel:
+                payloads[ALIASES['kernel']] = args.kernel
+            if args.initrd:
+                payloads[ALIASES['initrd']] = args.initrd
+            pack(args.template, args.output, payloads)
+    except (OSError, PackError) as error:
+        sys.exit('%s: %s' % (args.template, error))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+#
+# PROJECT:		FreeLoader wrapper for Apple TV
+# LICENSE:		MIT (https://spdx.org/licenses/MIT)
+# PURPOSE:		Convert a PNG into the run-length encoded BGRX splash logo drawn by console.c
+# COPYRIGHT:	Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+#
+# Output format (little endian), see SPLASH_HEADER in include/console.h:
+#   u32 magic 'SPLS', u32 width, u32 height, u32 size of the run data in bytes
+#   runs: u32 length, then one BGRX color (fill) or, if SPLASH_RUN_LITERAL is set, length BGRX colors (copy)
+# Runs never cross rows. Alpha is blended against the background color at build time.
+#
+
+import struct
+import sys
+import zlib
+
+SPLASH_MAGIC = 0x534C5053  # 'SPLS'
+SPLASH_RUN_LITERAL = 0x80000000
+SPLASH_MIN_FILL = 3  # shorter runs are cheaper as part of a literal
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    return b if pb <= pc else c
+
+
+def read_png(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        sys.exit('%s: not a PNG file' % path)
+
+    pos, idat = 8, b''
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        if kind == b'IHDR':
+            width, height, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif kind == b'IDAT':
+            idat += chunk
+        elif kind == b'IEND':
+            break
+        pos += 12 + length
+
+    if depth != 8 or color not in (2, 6) or interlace:
+        sys.exit('%s: only non-interlaced 8-bit RGB and RGBA images are supported' % path)
+
+    bpp = 4 if color == 6 else 3
+    stride = width * bpp
+    raw = zlib.decompress(idat)
+    rows, prev = [], bytearray(stride)
+    for y in range(height):
+        kind = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for x in range(stride):
+            a = line[x - bpp] if x >= bpp else 0
+            b = prev[x]
+            c = prev[x - bpp] if x >= bpp else 0
+            if kind == 1:
+                line[x] = (line[x] + a) & 0xFF
+            elif kind == 2:
+                line[x] = (line[x] + b) & 0xFF
+            elif kind == 3:
+                line[x] = (line[x] + ((a + b) >> 1)) & 0xFF
+            elif kind == 4:
+                line[x] = (line[x] + paeth(a, b, c)) & 0xFF
+        rows.append(line)
+        prev = line
+    return width, height, bpp, rows
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.exit('usage: %s input.png output.rle [background 0xRRGGBB]' % sys.argv[0])
+    background = int(sys.argv[3], 0) if len(sys.argv) == 4 else 0
+    bg = ((background >> 16) & 0xFF, (background >> 8) & 0xFF, background & 0xFF)
+
+    width, height, bpp, rows = read_png(sys.argv[1])
+    out = bytearray()
+    for line in rows:
+        colors = []
+        for x in range(width):
+            px = line[x * bpp:(x + 1) * bpp]
+            alpha = px[3] if bpp == 4 else 255
+            r, g, b = (((px[i] * alpha) + (bg[i] * (255 - alpha)) + 127) // 255 for i in range(3))
+            colors.append((r << 16) | (g << 8) | b)
+
+        x, literal = 0, []
+        while x < width:
+            end = x
+            while end < width and colors[end] == colors[x]:
+                end += 1
+            if end - x >= SPLASH_MIN_FILL:
+                if literal:
+                    out += struct.pack('<I%dI' % len(literal), SPLASH_RUN_LITERAL | len(literal), *literal)
+                    literal = []
+                out += struct.pack('<II', end - x, colors[x])
+            else:
+                literal += colors[x:end]
+            x = end
+        if literal:
+            out += struct.pack('<I%dI' % len(literal), SPLASH_RUN_LITERAL | len(literal), *literal)
+
+    with open(sys.argv[2], 'wb') as f:
+        f.write(struct.pack('<IIII', SPLASH_MAGIC, width, height, len(out)))
+        f.write(out)
+
+
+if __name__ == '__main__':
+    main()
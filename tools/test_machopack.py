@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+#
+# PROJECT:		FreeLoader wrapper for Apple TV
+# LICENSE:		MIT (https://spdx.org/licenses/MIT)
+# PURPOSE:		Tests for machopack.py against small synthetic mach_kernel images (make tools-test)
+# COPYRIGHT:	Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+#
+
+import os
+import struct
+import tempfile
+import unittest
+
+import machopack
+
+TEXT_DATA = b'\x90' * 0x1000
+DATA_DATA = b'\x5a' * 0x1000
+LINKEDIT_DATA = b'symbols and strings'.ljust(0x40, b'\0')
+BASE = 0x2000000
+
+
+def build_image(segments):
+    """
+    Build a 32-bit Mach-O executable. segments is a list of (name, file data, [(section, size, align), ...]) laid out
+    one page apart in order; __LINKEDIT also gets an LC_SYMTAB pointing into it.
+    """
+    commands = []
+    data = {}
+    sizeofcmds = sum(machopack.SEGMENT.size + len(s[2]) * machopack.SECTION.size for s in segments) + 24
+    offset = vmaddr = 0
+    symtab = None
+    for name, contents, sections in segments:
+        if offset == 0:
+            contents = bytes(machopack.HEADER.size + sizeofcmds) + contents[machopack.HEADER.size + sizeofcmds:]
+        raw_sections = b''
+        address = vmaddr
+        for section, size, alignment in sections:
+            address = machopack.align(address, 1 << alignment)
+            raw_sections += machopack.SECTION.pack(section.encode(), name.encode(), BASE + address, size,
+                                                   address - vmaddr + offset, alignment, 0, 0, 0, 0, 0)
+            address += size
+        vmsize = machopack.align(len(contents), machopack.PAGE_SIZE)
+        commands.append(machopack.SEGMENT.pack(machopack.MACHO_LC_SEGMENT,
+                                               machopack.SEGMENT.size + len(raw_sections), name.encode(),
+                                               BASE + vmaddr, vmsize, offset, len(contents), 7, 7,
+                                               len(sections), 0) + raw_sections)
+        data[offset] = contents
+        if name == machopack.LINKEDIT_SEGMENT:
+            symtab = struct.pack('<6I', machopack.MACHO_LC_SYMTAB, 24, offset, 1, offset + 0x10, 0x30)
+        offset += vmsize
+        vmaddr += vmsize
+    commands.append(symtab or struct.pack('<6I', machopack.MACHO_LC_SYMTAB, 24, 0, 0, 0, 0))
+
+    image = bytearray(offset if segments[-1][0] != machopack.LINKEDIT_SEGMENT else
+                      offset - machopack.PAGE_SIZE + len(segments[-1][1]))
+    for at, contents in data.items():
+        image[at:at + len(contents)] = contents
+    header = machopack.HEADER.pack(machopack.MACHO_MAGIC, 7, 3, 2, len(commands), sizeofcmds, 0)
+    image[:len(header) + sizeofcmds] = header + b''.join(commands)
+    return bytes(image)
+
+
+def payload(kernel=0x800, initrd=0x10, cpio=0x100):
+    contents = bytearray(machopack.PAGE_SIZE * 2)
+    contents[:kernel] = b'K' * kernel
+    contents[0x1000:0x1000 + initrd] = b'I' * initrd
+    return (machopack.PAYLOAD_SEGMENT, bytes(contents),
+            [('__vmlinuz', kernel, 12), ('__initrd', initrd, 12), ('__cpio', cpio, 0)])
+
+
+def linked_image():
+    return build_image([('__TEXT', TEXT_DATA, [('__text', 0x1000, 0)]),
+                        ('__DATA', DATA_DATA, [('__data', 0x1000, 0)]),
+                        payload(),
+                        (machopack.LINKEDIT_SEGMENT, LINKEDIT_DATA, [])])
+
+
+class MachoPackTest(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def write(self, name, data):
+        path = os.path.join(self.directory.name, name)
+        with open(path, 'wb') as f:
+            f.write(data)
+        return path
+
+    def read(self, path):
+        with open(path, 'rb') as f:
+            return f.read()
+
+    def load(self, path):
+        with open(path, 'rb') as f:
+            return machopack.Image(f), self.read(path)
+
+    def section(self, image, segment_name, section_name):
+        for section in image.segment(segment_name)[2]:
+            if machopack.cstring(section[1][machopack.SECT_NAME]) == section_name:
+                return section[1]
+        self.fail('no %s,%s' % (segment_name, section_name))
+
+    def check_packed(self, path, kernel, initrd):
+        image, data = self.load(path)
+        for name, contents in (('__vmlinuz', kernel), ('__initrd', initrd)):
+            section = self.section(image, machopack.PAYLOAD_SEGMENT, name)
+            self.assertEqual(section[machopack.SECT_SIZE], len(contents))
+            self.assertEqual(section[machopack.SECT_ADDR] % machopack.PAGE_SIZE, 0)
+            offset = section[machopack.SECT_OFFSET]
+            self.assertEqual(data[offset:offset + len(contents)], contents)
+
+        # loader code and data stay where they were linked
+        for name, contents in (('__TEXT', TEXT_DATA), ('__DATA', DATA_DATA)):
+            segment = image.segment(name)[1]
+            self.assertEqual(segment[machopack.SEG_VMADDR] - BASE, segment[machopack.SEG_FILEOFF])
+        self.assertEqual(data[0x1000:0x2000], DATA_DATA)
+
+        # __LINKEDIT follows the payload and the symbol table follows __LINKEDIT
+        payload_segment = image.segment(machopack.PAYLOAD_SEGMENT)[1]
+        linkedit = image.segment(machopack.LINKEDIT_SEGMENT)[1]
+        self.assertEqual(linkedit[machopack.SEG_FILEOFF],
+                         payload_segment[machopack.SEG_FILEOFF] + payload_segment[machopack.SEG_VMSIZE])
+        self.assertEqual(linkedit[machopack.SEG_VMADDR],
+                         payload_segment[machopack.SEG_VMADDR] + payload_segment[machopack.SEG_VMSIZE])
+        symoff, _, stroff = struct.unpack_from('<3I', image.data, image.symtab + 8)
+        self.assertEqual(symoff, linkedit[machopack.SEG_FILEOFF])
+        self.assertEqual(stroff, symoff + 0x10)
+        self.assertEqual(data[symoff:], LINKEDIT_DATA)
+
+    def test_copy_grows_payload(self):
+        template = self.write('mach_kernel', linked_image())
+        kernel = self.write('bzImage', bytes(range(256)) * 40)
+        initrd = self.write('initrd.img', b'initrd' * 1000)
+        output = os.path.join(self.directory.name, 'out')
+
+        machopack.pack(template, output, {'__vmlinuz': kernel, '__initrd': initrd})
+        self.check_packed(output, self.read(kernel), self.read(initrd))
+        self.assertEqual(self.read(template), linked_image())
+
+    def test_in_place_shrinks_payload(self):
+        template = self.write('mach_kernel', linked_image())
+        kernel = self.write('bzImage', b'k' * 0x100)
+
+        machopack.pack(template, None, {'__vmlinuz': kernel})
+        self.check_packed(template, b'k' * 0x100, b'I' * 0x10)
+
+    def test_rejects_segment_after_payload(self):
+        # __DATA linked behind the payload would have to move, but the loader's code still uses its old addresses
+        image = build_image([('__TEXT', TEXT_DATA, [('__text', 0x1000, 0)]),
+                             payload(),
+                             ('__DATA', DATA_DATA, [('__data', 0x1000, 0)]),
+                             (machopack.LINKEDIT_SEGMENT, LINKEDIT_DATA, [])])
+        template = self.write('mach_kernel', image)
+        kernel = self.write('bzImage', b'k' * 0x2000)
+
+        with self.assertRaisesRegex(machopack.PackError, '__DATA follows __PAYLOAD'):
+            machopack.pack(template, None, {'__vmlinuz': kernel})
+        self.assertEqual(self.read(template), image)
+
+    def test_rejects_unknown_section(self):
+        template = self.write('mach_kernel', linked_image())
+        kernel = self.write('bzImage', b'k')
+
+        with self.assertRaisesRegex(machopack.PackError, 'no __PAYLOAD section __missing'):
+            machopack.pack(template, os.path.join(self.directory.name, 'out'), {'__missing': kernel})
+
+
+if __name__ == '__main__':
+    unittest.main()
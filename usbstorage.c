@@ -0,0 +1,202 @@
+/*
+ * PROJECT:     FreeLoader wrapper for Apple TV
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     USB mass storage (Bulk-Only Transport, SCSI) driver for the original Apple TV
+ * COPYRIGHT:   Copyright 2023-2024 DistroHopper39B (distrohopper39b.business@gmail.com)
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <linuxloader.h>
+
+/* GLOBALS ********************************************************************/
+
+static USB_STORAGE UsbStorageDevices[USB_STORAGE_MAX_DEVICES];
+static u32 UsbStorageCount;
+
+static USB_STORAGE_CBW UsbStorageCbw __aligned(32);
+static USB_STORAGE_CSW UsbStorageCsw __aligned(32);
+
+/* FUNCTIONS ******************************************************************/
+
+/* Bulk-Only reset recovery: class reset, then clear both halts */
+static
+void UsbStorageResetRecovery(PUSB_STORAGE Storage) {
+    USB_SETUP_PACKET Setup = { USB_TYPE_CLASS | USB_RECIP_INTERFACE, USB_STORAGE_RESET, 0,
+                               Storage->Interface, 0 };
+
+    EhciControlTransfer(Storage->Device, &Setup, NULL);
+    EhciClearHalt(Storage->Device, Storage->BulkIn, Storage->BulkInAddress);
+    EhciClearHalt(Storage->Device, Storage->BulkOut, Storage->BulkOutAddress);
+}
+
+/*
+ * Run one SCSI command that reads Length bytes into Data. The CBW, the whole data stage and the CSW are queued
+ * at once, so the controller moves from one phase to the next without waiting for us.
+ */
+static
+bool UsbStorageCommand(PUSB_STORAGE Storage, const u8 *Command, u8 CommandLength, void *Data, u32 Length) {
+    PEHCI_QTD Cbw, CbwLast, Csw, CswLast, DataFirst, DataLast;
+
+    memset(&UsbStorageCbw, 0, sizeof(USB_STORAGE_CBW));
+    UsbStorageCbw.Signature = USB_STORAGE_CBW_SIGNATURE;
+    UsbStorageCbw.Tag = ++Storage->Tag;
+    UsbStorageCbw.DataTransferLength = Length;
+    UsbStorageCbw.Flags = USB_STORAGE_CBW_IN;
+    UsbStorageCbw.CommandLength = CommandLength;
+    memcpy(UsbStorageCbw.Command, Command, CommandLength);
+    memset(&UsbStorageCsw, 0, sizeof(USB_STORAGE_CSW));
+
+    EhciFreeQtds();
+    Csw = EhciBuildChain(EHCI_TOKEN_PID_IN, &UsbStorageCsw, sizeof(USB_STORAGE_CSW), NULL, NULL, &CswLast);
+    Cbw = EhciBuildChain(EHCI_TOKEN_PID_OUT, &UsbStorageCbw, sizeof(USB_STORAGE_CBW), NULL, NULL, &CbwLast);
+    if (!Csw || !Cbw) {
+        return FALSE;
+    }
+    DataFirst = Csw;
+    if (Length) {
+        /* a short packet skips straight to the status phase */
+        DataFirst = EhciBuildChain(EHCI_TOKEN_PID_IN, Data, Length, Csw, Csw, &DataLast);
+        if (!DataFirst) {
+            return FALSE;
+        }
+    }
+
+    EhciSubmit(Storage->BulkIn, DataFirst);
+    EhciSubmit(Storage->BulkOut, Cbw);
+
+    if (!EhciWait(Storage->BulkOut, CbwLast) || !EhciWait(Storage->BulkIn, CswLast)) {
+        UsbStorageResetRecovery(Storage);
+        return FALSE;
+    }
+    if (UsbStorageCsw.Signature != USB_STORAGE_CSW_SIGNATURE || UsbStorageCsw.Tag != Storage->Tag) {
+        UsbStorageResetRecovery(Storage);
+        return FALSE;
+    }
+    return UsbStorageCsw.Status == 0 && UsbStorageCsw.DataResidue == 0;
+}
+
+/* Wait for the medium and read its geometry. Early commands may fail with a unit attention. */
+static
+bool UsbStorageReadCapacity(PUSB_STORAGE Storage) {
+    u8 Inquiry[6] = { SCSI_INQUIRY, 0, 0, 0, 36, 0 };
+    u8 RequestSense[6] = { SCSI_REQUEST_SENSE, 0, 0, 0, 18, 0 };
+    u8 ReadCapacity[10] = { SCSI_READ_CAPACITY_10 };
+    u8 Buffer[36] __aligned(4);
+
+    if (!UsbStorageCommand(Storage, Inquiry, sizeof(Inquiry), Buffer, 36)) {
+        return FALSE;
+    }
+
+    for (int Try = 0; Try < 5; Try++) {
+        if (UsbStorageCommand(Storage, ReadCapacity, sizeof(ReadCapacity), Buffer, 8)) {
+            /* big endian last LBA and block size */
+            Storage->BlockCount = ((Buffer[0] << 24) | (Buffer[1] << 16) | (Buffer[2] << 8) | Buffer[3]) + 1;
+            Storage->BlockSize = (Buffer[4] << 24) | (Buffer[5] << 16) | (Buffer[6] << 8) | Buffer[7];
+            return Storage->BlockSize != 0;
+        }
+        UsbStorageCommand(Storage, RequestSense, sizeof(RequestSense), Buffer, 18);
+        msleep(100);
+    }
+    return FALSE;
+}
+
+/* Look for a SCSI Bulk-Only interface and its two bulk endpoints */
+static
+bool UsbStorageProbe(PUSB_DEVICE Device, PUSB_STORAGE Storage) {
+    PUSB_INTERFACE_DESCRIPTOR Interface = NULL;
+    u16 InMaxPacket = 0, OutMaxPacket = 0;
+
+    memset(Storage, 0, sizeof(USB_STORAGE));
+    for (u32 Offset = 0; Offset + 2 <= Device->ConfigLength && Device->Config[Offset] != 0;
+         Offset += Device->Config[Offset]) {
+        u8 *Descriptor = &Device->Config[Offset];
+
+        if (Descriptor[1] == USB_DT_INTERFACE) {
+            if (Interface) {
+                break;
+            }
+            PUSB_INTERFACE_DESCRIPTOR Candidate = (PUSB_INTERFACE_DESCRIPTOR) Descriptor;
+            if (Candidate->InterfaceClass == USB_CLASS_MASS_STORAGE &&
+                Candidate->InterfaceSubclass == USB_SUBCLASS_SCSI &&
+                Candidate->InterfaceProtocol == USB_PROTOCOL_BULK_ONLY) {
+                Interface = Candidate;
+            }
+        } else if (Descriptor[1] == USB_DT_ENDPOINT && Interface) {
+            PUSB_ENDPOINT_DESCRIPTOR Endpoint = (PUSB_ENDPOINT_DESCRIPTOR) Descriptor;
+            if ((Endpoint->Attributes & 3) != USB_ENDPOINT_BULK) {
+                continue;
+            }
+            if (Endpoint->EndpointAddress & USB_DIR_IN) {
+                Storage->BulkInAddress = Endpoint->EndpointAddress;
+                InMaxPacket = Endpoint->MaxPacketSize;
+            } else {
+                Storage->BulkOutAddress = Endpoint->EndpointAddress;
+                OutMaxPacket = Endpoint->MaxPacketSize;
+            }
+        }
+    }
+    if (!Interface || !InMaxPacket || !OutMaxPacket) {
+        return FALSE;
+    }
+
+    Storage->Device = Device;
+    Storage->Interface = Interface->InterfaceNumber;
+    Storage->BulkIn = EhciOpenPipe(Device->Address, Storage->BulkInAddress, InMaxPacket, FALSE);
+    Storage->BulkOut = EhciOpenPipe(Device->Address, Storage->BulkOutAddress, OutMaxPacket, FALSE);
+    if (!Storage->BulkIn || !Storage->BulkOut) {
+        return FALSE;
+    }
+    return UsbStorageReadCapacity(Storage);
+}
+
+/* Bring up EHCI and find mass storage devices. Returns the number of usable devices. */
+u32 UsbStorageInit() {
+    PUSB_DEVICE Device;
+
+    UsbStorageCount = 0;
+    EhciInit();
+    for (u32 i = 0; (Device = EhciGetDevice(i)) && UsbStorageCount < USB_STORAGE_MAX_DEVICES; i++) {
+        PUSB_STORAGE Storage = &UsbStorageDevices[UsbStorageCount];
+
+        if (UsbStorageProbe(Device, Storage)) {
+            debug_printf("USB mass storage on address %u: %u blocks of %u bytes\n", Device->Address,
+                         Storage->BlockCount, Storage->BlockSize);
+            UsbStorageCount++;
+        }
+    }
+    return UsbStorageCount;
+}
+
+PUSB_STORAGE UsbStorageGetDevice(u32 Index) {
+    if (Index >= UsbStorageCount) {
+        return NULL;
+    }
+    return &UsbStorageDevices[Index];
+}
+
+/* Read blocks with READ(10), as few and as large commands as the qTD pool allows */
+bool UsbStorageReadBlocks(PUSB_STORAGE Storage, u32 Lba, u32 Count, void *Buffer) {
+    u8 *Position = (u8 *) Buffer;
+    u32 MaxBlocks;
+
+    if (!Storage || Lba + Count > Storage->BlockCount) {
+        return FALSE;
+    }
+    MaxBlocks = USB_STORAGE_MAX_TRANSFER / Storage->BlockSize;
+    while (Count != 0) {
+        u32 Blocks = (Count < MaxBlocks) ? Count : MaxBlocks;
+        u8 Read10[10] = { SCSI_READ_10, 0,
+                          (Lba >> 24) & 0xFF, (Lba >> 16) & 0xFF, (Lba >> 8) & 0xFF, Lba & 0xFF,
+                          0, (Blocks >> 8) & 0xFF, Blocks & 0xFF, 0 };
+
+        if (!UsbStorageCommand(Storage, Read10, sizeof(Read10), Position, Blocks * Storage->BlockSize)) {
+            error("USB mass storage read of %u blocks at %u failed!\n", Blocks, Lba);
+            return FALSE;
+        }
+        Lba += Blocks;
+        Count -= Blocks;
+        Position += Blocks * Storage->BlockSize;
+    }
+    return TRUE;
+}
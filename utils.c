@@ -211,57 +211,35 @@ size_t strlen(const char *s)
 }
 */
 /**********************************************************************/
-void* memcpy(void *dest, const void *src, size_t count)
-{
-	char *tmp = (char *) dest, *s = (char *) src;
-
-	while (count--)
-		*tmp++ = *s++;
-
-	return dest;
-}
 /*
-void * memcpy(void * to, const void * from, size_t n)
+ * memcpy() and memset() move the kernel and initrd around, so they use the
+ * string instructions instead of byte loops (which -O0 makes even slower).
+ */
+void* memcpy(void *dest, const void *src, size_t count)
 {
-	int d0, d1, d2;
+	long d0, d1, d2;
 	__asm__ __volatile__(
-       		"rep ; movsl\n\t"
-       		"testb $2,%b4\n\t"
-      		"je 1f\n\t"
-      	 	"movsw\n"
-      		"1:\ttestb $1,%b4\n\t"
-     		"je 2f\n\t"
-     		"movsb\n"
-     	  	"2:"
-     		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
-		:"0" (n/4), "q" (n),"1" ((long) to),"2" ((long) from)
-	       	: "memory");
-	return (to);
+		"rep ; movsl\n\t"
+		"mov %4, %0\n\t"
+		"rep ; movsb"
+		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
+		: "0" (count / 4), "g" (count & 3), "1" (dest), "2" (src)
+		: "memory");
+	return dest;
 }
-*/
 /**********************************************************************/
 void* memset(void *s, int c, size_t count)
 {
-	char *xs = (char *) s;
-
-	while (count--)
-		*xs++ = c;
-		
-	return s;
-}
-/*
-void * memset(void *s, int c,  size_t count)
-{
-  	int d0, d1;
+	long d0, d1;
 	__asm__ __volatile__(
-	        "rep\n\t"
-	        "stosb"
-	        : "=&c" (d0), "=&D" (d1)
-	        :"a" (c),"1" (s),"0" (count)
-	        :"memory");
+		"rep ; stosl\n\t"
+		"mov %3, %0\n\t"
+		"rep ; stosb"
+		: "=&c" (d0), "=&D" (d1)
+		: "a" ((unsigned char) c * 0x01010101U), "g" (count & 3), "0" (count / 4), "1" (s)
+		: "memory");
 	return s;
 }
-*/
 /**********************************************************************/
 int memcmp(const void *cs,const void *ct, size_t count)
 {
@@ -271,4 +249,27 @@ int memcmp(const void *cs,const void *ct, size_t count)
 	for( su1 = cs, su2 = ct; 0 < count; ++su1, ++su2, count--)
 		if ((res = *su1 - *su2) != 0) break;
 	return res;
-}
\ No newline at end of file
+}
+/**********************************************************************/
+/*
+ * CRC-32 as used by zlib and gzip. Start with crc = 0 and pass the
+ * previous result to continue over more data.
+ */
+u32 crc32(u32 crc, const void *buf, size_t len)
+{
+	static u32		table[256];
+	const u8		*p = buf;
+
+	if (table[1] == 0) {
+		for (u32 i = 0; i < 256; i++) {
+			u32 c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			table[i] = c;
+		}
+	}
+	crc = ~crc;
+	while (len--)
+		crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}